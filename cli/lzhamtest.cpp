@@ -26,9 +26,11 @@
 #elif defined(WIN32)
    #define WIN32_LEAN_AND_MEAN
    #include <windows.h>
+   #include <process.h>
    #define LZHAM_USE_LZHAM_DLL 1
 #else
    #include <unistd.h>
+   #include <pthread.h>
    #define Sleep(ms) usleep(ms*1000)
    #define _aligned_malloc(size, alignment) memalign(alignment, size)
    #define _aligned_free free
@@ -92,7 +94,11 @@ struct comp_options
       m_force_polar_codes(false),
       m_randomize_params(false),
       m_extreme_parsing(false),
-      m_deterministic_parsing(false)
+      m_deterministic_parsing(false),
+      m_independent_chunks(false),
+      m_huge_pages(false),
+      m_long_distance_matching(false),
+      m_helpers_share_cache(false)
    {
    }
 
@@ -108,6 +114,10 @@ struct comp_options
       printf("Extreme parsing: %u\n", (uint)m_extreme_parsing);
       printf("Randomize parameters: %u\n", m_randomize_params);
       printf("Deterministic parsing: %u\n", m_deterministic_parsing);
+      printf("Independent chunks: %u\n", m_independent_chunks);
+      printf("Huge pages: %u\n", m_huge_pages);
+      printf("Long distance matching: %u\n", m_long_distance_matching);
+      printf("Helpers share cache: %u, helper CPUs: %u\n", m_helpers_share_cache, (uint)m_helper_cpus.size());
    }
 
    lzham_compress_level m_comp_level;
@@ -120,6 +130,11 @@ struct comp_options
    bool m_randomize_params;
    bool m_extreme_parsing;
    bool m_deterministic_parsing;
+   bool m_independent_chunks;
+   bool m_huge_pages;
+   bool m_long_distance_matching;
+   bool m_helpers_share_cache;
+   std::vector<lzham_uint32> m_helper_cpus;
 };
 
 static void print_usage()
@@ -130,6 +145,8 @@ static void print_usage()
    printf("c - Compress \"infile\" to \"outfile\"\n");
    printf("d - Decompress \"infile\" to \"outfile\"\n");
    printf("a - Recursively compress all files under \"inpath\"\n");
+   printf("t - Test the API (framed container and range decoding, resets, shared pools,\n");
+   printf("    flushes, compressed size bound, memory estimates) on \"infile\"\n");
    printf("\n");
    printf("Options:\n");
    printf("-m[0-4] - Compression level: 0=fastest, 1=faster, 2=default, 3=better, 4=uber\n");
@@ -139,7 +156,7 @@ static void print_usage()
    printf("-c - Do not compute or verify adler32 checksum during decompression (faster).\n");
    printf("-u - Use unbuffered decompression on files that can fit into memory.\n");
    printf("     Unbuffered decompression is faster, but may have more I/O overhead.\n");
-   printf("-t[0-16] - Number of compression helper threads. Default=# CPU's-1.\n");
+   printf("-t[0-128] - Number of compression helper threads. Default=# CPU's-1.\n");
    printf("           Note: The total number of threads will be 1 + num_helper_threads,\n");
    printf("           because the main thread is counted separately.\n");
    printf("-v - Immediately decompress compressed file after compression for verification.\n");
@@ -149,6 +166,14 @@ static void print_usage()
    printf("     predictable output files when enabled, but less scalability.\n");
    printf("     The default is disabled, so the generated output data may slightly vary\n");
    printf("     between runs when multithreaded compression is enabled.\n");
+   printf("-i - Compress the whole file in memory, split into independent chunks which\n");
+   printf("     are compressed in parallel (faster, slightly lower ratio).\n");
+   printf("-l - Allocate the dictionary and match finder tables with huge pages\n");
+   printf("     (faster with large dictionaries).\n");
+   printf("-f - Long distance matching: also look for long repeats far back in the\n");
+   printf("     dictionary (helps large files with big repeated regions).\n");
+   printf("-a[cpu,cpu,...] - Run the helper threads on the listed CPUs, or without a\n");
+   printf("     list, on the CPUs sharing a cache with the main thread.\n");
 }
 
 static void print_error(const char *pMsg, ...)
@@ -324,6 +349,23 @@ static bool compress_streaming(ilzham &lzham_dll, const char* pSrc_filename, con
    {
       params.m_compress_flags |= LZHAM_COMP_FLAG_DETERMINISTIC_PARSING;
    }
+   if (options.m_huge_pages)
+   {
+      params.m_alloc_policy = LZHAM_ALLOC_POLICY_HUGE_PAGES;
+   }
+   if (options.m_long_distance_matching)
+   {
+      params.m_compress_flags |= LZHAM_COMP_FLAG_LONG_DISTANCE_MATCHING;
+   }
+   if (options.m_helpers_share_cache)
+   {
+      params.m_compress_flags |= LZHAM_COMP_FLAG_HELPERS_SHARE_CACHE;
+   }
+   if (!options.m_helper_cpus.empty())
+   {
+      params.m_num_helper_cpus = static_cast<lzham_uint32>(options.m_helper_cpus.size());
+      params.m_pHelper_cpus = &options.m_helper_cpus[0];
+   }
    params.m_cpucache_line_size = 0;
    params.m_cpucache_total_lines = 0;
 
@@ -458,6 +500,141 @@ static bool compress_streaming(ilzham &lzham_dll, const char* pSrc_filename, con
    return true;
 }
 
+static bool compress_memory(ilzham &lzham_dll, const char* pSrc_filename, const char *pDst_filename, const comp_options &options)
+{
+   printf("Testing: Memory compression\n");
+
+   FILE *pInFile = fopen(pSrc_filename, "rb");
+   if (!pInFile)
+   {
+      print_error("Unable to read file: %s\n", pSrc_filename);
+      return false;
+   }
+
+   _fseeki64(pInFile, 0, SEEK_END);
+   uint64 src_file_size = _ftelli64(pInFile);
+   _fseeki64(pInFile, 0, SEEK_SET);
+
+   if (src_file_size > static_cast<size_t>(-1))
+   {
+      print_error("File is too large for memory compression: %s\n", pSrc_filename);
+      fclose(pInFile);
+      return false;
+   }
+
+   size_t src_len = static_cast<size_t>(src_file_size);
+   size_t cmp_buf_size = src_len + (src_len >> 3) + 4096;
+
+   uint8 *pSrc_buf = static_cast<uint8*>(malloc(my_max(1U, src_len)));
+   uint8 *pCmp_buf = static_cast<uint8*>(malloc(cmp_buf_size));
+   if ((!pSrc_buf) || (!pCmp_buf))
+   {
+      print_error("Out of memory!\n");
+      free(pSrc_buf);
+      free(pCmp_buf);
+      fclose(pInFile);
+      return false;
+   }
+
+   if (fread(pSrc_buf, 1, src_len, pInFile) != src_len)
+   {
+      print_error("Failure reading from source file!\n");
+      free(pSrc_buf);
+      free(pCmp_buf);
+      fclose(pInFile);
+      return false;
+   }
+
+   fclose(pInFile);
+   pInFile = NULL;
+
+   lzham_compress_params params;
+   memset(&params, 0, sizeof(params));
+   params.m_struct_size = sizeof(lzham_compress_params);
+   params.m_dict_size_log2 = options.m_dict_size_log2;
+   params.m_max_helper_threads = options.m_max_helper_threads;
+   params.m_level = options.m_comp_level;
+   if (options.m_force_polar_codes)
+      params.m_compress_flags |= LZHAM_COMP_FLAG_FORCE_POLAR_CODING;
+   if (options.m_extreme_parsing)
+      params.m_compress_flags |= LZHAM_COMP_FLAG_EXTREME_PARSING;
+   if (options.m_deterministic_parsing)
+      params.m_compress_flags |= LZHAM_COMP_FLAG_DETERMINISTIC_PARSING;
+   if (options.m_independent_chunks)
+      params.m_compress_flags |= LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS;
+   if (options.m_long_distance_matching)
+      params.m_compress_flags |= LZHAM_COMP_FLAG_LONG_DISTANCE_MATCHING;
+   if (options.m_helpers_share_cache)
+      params.m_compress_flags |= LZHAM_COMP_FLAG_HELPERS_SHARE_CACHE;
+   if (!options.m_helper_cpus.empty())
+   {
+      params.m_num_helper_cpus = static_cast<lzham_uint32>(options.m_helper_cpus.size());
+      params.m_pHelper_cpus = &options.m_helper_cpus[0];
+   }
+   if (options.m_huge_pages)
+      params.m_alloc_policy = LZHAM_ALLOC_POLICY_HUGE_PAGES;
+
+   timer_ticks start_time = timer::get_ticks();
+
+   size_t cmp_len = cmp_buf_size;
+   lzham_uint32 adler32 = 0;
+   lzham_compress_status_t status = lzham_dll.lzham_compress_memory(&params, pCmp_buf, &cmp_len, pSrc_buf, src_len, &adler32);
+
+   double total_time = timer::ticks_to_secs(my_max(1, timer::get_ticks() - start_time));
+
+   free(pSrc_buf);
+   pSrc_buf = NULL;
+
+   if (status != LZHAM_COMP_STATUS_SUCCESS)
+   {
+      print_error("Compression failed with status %i\n", status);
+      free(pCmp_buf);
+      return false;
+   }
+
+   FILE *pOutFile = fopen(pDst_filename, "wb");
+   if (!pOutFile)
+   {
+      print_error("Unable to create file: %s\n", pDst_filename);
+      free(pCmp_buf);
+      return false;
+   }
+
+   fputc('L', pOutFile);
+   fputc('Z', pOutFile);
+   fputc('H', pOutFile);
+   fputc('0', pOutFile);
+   fputc(options.m_dict_size_log2, pOutFile);
+
+   for (uint i = 0; i < 8; i++)
+   {
+      fputc(static_cast<int>((src_file_size >> (i * 8)) & 0xFF), pOutFile);
+   }
+
+   bool write_failed = (fwrite(pCmp_buf, 1, cmp_len, pOutFile) != cmp_len);
+
+   free(pCmp_buf);
+   pCmp_buf = NULL;
+
+   uint64 cmp_file_size = _ftelli64(pOutFile);
+
+   if (fclose(pOutFile) == EOF)
+      write_failed = true;
+
+   if (write_failed)
+   {
+      print_error("Failure writing to destination file!\n");
+      return false;
+   }
+
+   printf("Success\n");
+   printf("Input file size: " QUAD_INT_FMT ", Compressed file size: " QUAD_INT_FMT ", Ratio: %3.2f%%\n", src_file_size, cmp_file_size, src_file_size ? ((1.0f - (static_cast<float>(cmp_file_size) / src_file_size)) * 100.0f) : 0.0f);
+   printf("Compression time: %3.6f\nConsumption rate: %9.1f bytes/sec, Emission rate: %9.1f bytes/sec\n", total_time, src_file_size / total_time, cmp_file_size / total_time);
+   printf("Input file adler32: 0x%08X\n", adler32);
+
+   return true;
+}
+
 static bool decompress_file(ilzham &lzham_dll, const char* pSrc_filename, const char *pDst_filename, comp_options options)
 {
    FILE *pInFile = fopen(pSrc_filename, "rb");
@@ -510,7 +687,7 @@ static bool decompress_file(ilzham &lzham_dll, const char* pSrc_filename, const
       orig_file_size |= (static_cast<uint64>(fgetc(pInFile)) << (i * 8));
    }
 
-   int total_header_bytes = ftell(pInFile);
+   int64 total_header_bytes = _ftelli64(pInFile);
 
    // Avoid running out of memory on large files when using unbuffered decompression.
 #ifdef _XBOX
@@ -554,6 +731,8 @@ static bool decompress_file(ilzham &lzham_dll, const char* pSrc_filename, const
    params.m_dict_size_log2 = dict_size;
    params.m_compute_adler32 = options.m_compute_adler32_during_decomp;
    params.m_output_unbuffered = options.m_unbuffered_decompression;
+   if (options.m_huge_pages)
+      params.m_alloc_policy = LZHAM_ALLOC_POLICY_HUGE_PAGES;
 
    timer_ticks start_time = timer::get_ticks();
    double decomp_only_time = 0;
@@ -962,7 +1141,7 @@ static bool test_recursive(ilzham &lzham_dll, const char *pPath, comp_options op
          file_options.print();
       }
 
-      bool status = compress_streaming(lzham_dll, src_file.c_str(), cmp_file, file_options);
+      bool status = file_options.m_independent_chunks ? compress_memory(lzham_dll, src_file.c_str(), cmp_file, file_options) : compress_streaming(lzham_dll, src_file.c_str(), cmp_file, file_options);
       if (!status)
       {
          print_error("Failed compressing file \"%s\" to \"%s\"\n", src_file.c_str(), cmp_file);
@@ -1043,134 +1222,1029 @@ static bool test_recursive(ilzham &lzham_dll, const char *pPath, comp_options op
    return true;
 }
 
-int main_internal(string_array cmd_line, int num_helper_threads, ilzham &lzham_dll)
+// API tests (mode "t"). Each one round trips the contents of a file through part of the library's API, and compares
+// the results with the source bytes.
+
+static bool read_test_file(const char* pSrc_filename, std::vector<uint8> &src_buf, size_t &src_len)
 {
-   comp_options options;
-   options.m_max_helper_threads = num_helper_threads;
+   FILE *pInFile = fopen(pSrc_filename, "rb");
+   if (!pInFile)
+   {
+      print_error("Unable to read file: %s\n", pSrc_filename);
+      return false;
+   }
 
-#ifdef _XBOX
-   options.m_dict_size_log2 = 21;
-#endif
+   _fseeki64(pInFile, 0, SEEK_END);
+   uint64 src_file_size = _ftelli64(pInFile);
+   _fseeki64(pInFile, 0, SEEK_SET);
 
-   if (!cmd_line.size())
+   if (src_file_size > static_cast<size_t>(-1))
    {
-      print_usage();
-      return simple_test(lzham_dll, options);
+      print_error("File is too large to test in memory: %s\n", pSrc_filename);
+      fclose(pInFile);
+      return false;
    }
 
-   enum op_mode_t
+   src_len = static_cast<size_t>(src_file_size);
+
+   // At least one byte, so &src_buf[0] is valid for empty files too.
+   src_buf.resize(my_max(static_cast<size_t>(1), src_len));
+
+   bool read_failed = (fread(&src_buf[0], 1, src_len, pInFile) != src_len);
+
+   fclose(pInFile);
+
+   if (read_failed)
    {
-      OP_MODE_INVALID = -1,
-      OP_MODE_COMPRESS = 0,
-      OP_MODE_DECOMPRESS = 1,
-      OP_MODE_ALL = 2
-   };
+      print_error("Failure reading from source file!\n");
+      return false;
+   }
 
-   op_mode_t op_mode = OP_MODE_INVALID;
+   return true;
+}
 
-   for (int i = 0; i < (int)cmd_line.size(); i++)
+// The tests never use a larger dictionary than the file needs.
+static void init_test_params(const comp_options &options, size_t src_len, lzham_compress_params &comp_params, lzham_decompress_params &decomp_params)
+{
+   int dict_size_log2 = LZHAM_MIN_DICT_SIZE_LOG2;
+   while ((dict_size_log2 < options.m_dict_size_log2) && ((static_cast<uint64>(1) << dict_size_log2) < src_len))
+      dict_size_log2++;
+
+   memset(&comp_params, 0, sizeof(comp_params));
+   comp_params.m_struct_size = sizeof(comp_params);
+   comp_params.m_dict_size_log2 = dict_size_log2;
+   comp_params.m_level = options.m_comp_level;
+   comp_params.m_max_helper_threads = options.m_max_helper_threads;
+   if (options.m_force_polar_codes)
+      comp_params.m_compress_flags |= LZHAM_COMP_FLAG_FORCE_POLAR_CODING;
+
+   memset(&decomp_params, 0, sizeof(decomp_params));
+   decomp_params.m_struct_size = sizeof(decomp_params);
+   decomp_params.m_dict_size_log2 = dict_size_log2;
+   decomp_params.m_compute_adler32 = true;
+}
+
+// Decodes range_len bytes at range_ofs from a framed container, and compares them with the source. Ranges running past
+// the end of the data must come back shortened.
+static bool test_range(ilzham &lzham_dll, const lzham_decompress_params &decomp_params, const uint8 *pCmp, size_t cmp_len, const uint8 *pSrc, size_t src_len, uint64 range_ofs, size_t range_len)
+{
+   const size_t expected_len = (range_ofs < src_len) ? my_min(range_len, static_cast<size_t>(src_len - range_ofs)) : 0;
+
+   std::vector<uint8> dst_buf(my_max(static_cast<size_t>(1), range_len));
+   size_t dst_len = range_len;
+   lzham_decompress_status_t status = lzham_dll.lzham_decompress_range(&decomp_params, &dst_buf[0], &dst_len, pCmp, cmp_len, range_ofs);
+
+   if ((status != LZHAM_DECOMP_STATUS_SUCCESS) || (dst_len != expected_len) || (memcmp(&dst_buf[0], pSrc + range_ofs, expected_len)))
    {
-      const std::string &str = cmd_line[i];
-      if (str[0] == '-')
-      {
-         if (str.size() < 2)
-         {
-            print_error("Invalid option: %s\n", str.c_str());
-            return EXIT_FAILURE;
-         }
-         switch (tolower(str[1]))
-         {
-            case 'u':
-            {
-               options.m_unbuffered_decompression = true;
-               break;
-            }
-            case 'd':
-            {
-               int dict_size = atoi(str.c_str() + 2);
-               if ((dict_size < LZHAM_MIN_DICT_SIZE_LOG2) || (dict_size > LZHAMTEST_MAX_POSSIBLE_DICT_SIZE))
-               {
-                  print_error("Invalid dictionary size: %s\n", str.c_str());
-                  return EXIT_FAILURE;
-               }
-               options.m_dict_size_log2 = dict_size;
-               break;
-            }
-            case 'm':
-            {
-               int comp_level = atoi(str.c_str() + 2);
-               if ((comp_level < 0) || (comp_level > (int)LZHAM_COMP_LEVEL_UBER))
-               {
-                  print_error("Invalid compression level: %s\n", str.c_str());
-                  return EXIT_FAILURE;
-               }
-               options.m_comp_level = static_cast<lzham_compress_level>(comp_level);
-               break;
-            }
-            case 't':
-            {
-               int num_threads = atoi(str.c_str() + 2);
-               if ((num_threads < 0) || (num_threads > LZHAM_MAX_HELPER_THREADS))
-               {
-                  print_error("Invalid number of helper threads: %s\n", str.c_str());
-                  return EXIT_FAILURE;
-               }
-               options.m_max_helper_threads = num_threads;
-               break;
-            }
-            case 'c':
-            {
-               options.m_compute_adler32_during_decomp = false;
-               break;
-            }
-            case 'v':
-            {
-               options.m_verify_compressed_data = true;
-               break;
-            }
-            case 'r':
-            {
-               options.m_randomize_params = true;
-               break;
-            }
-            case 'p':
-            {
-               options.m_force_polar_codes = true;
-               break;
-            }
-            case 'x':
-            {
-               options.m_extreme_parsing = true;
-               break;
-            }
-            case 'e':
-            {
-               options.m_deterministic_parsing = true;
-               break;
-            }
-            case 's':
-            {
-               int seed = atoi(str.c_str() + 2);
-               srand(seed);
-               printf("Using random seed: %i\n", seed);
-               break;
-            }
-            default:
-            {
-               print_error("Invalid option: %s\n", str.c_str());
-               return EXIT_FAILURE;
-            }
-         }
+      print_error("Decoding %u bytes at offset " QUAD_INT_FMT " failed (status %i, %u bytes decoded)\n", (uint)range_len, (uint64)range_ofs, status, (uint)dst_len);
+      return false;
+   }
 
-         cmd_line.erase(cmd_line.begin() + i);
-         i--;
+   return true;
+}
 
-         continue;
-      }
+static bool test_framed(ilzham &lzham_dll, const uint8 *pSrc, size_t src_len, const comp_options &options)
+{
+   printf("Testing: Framed container and range decoding\n");
 
-      if (str.size() != 1)
-      {
-         print_error("Invalid mode: %s\n", str.c_str());
+   lzham_compress_params comp_params;
+   lzham_decompress_params decomp_params;
+   init_test_params(options, src_len, comp_params, decomp_params);
+
+   // Small frames, so even modest files are split into several.
+   const uint frame_size = static_cast<uint>(my_min(my_max(static_cast<size_t>(4096), src_len / 4), static_cast<size_t>(LZHAM_DEFAULT_FRAME_SIZE)));
+   const size_t num_frames = (src_len + frame_size - 1) / frame_size;
+
+   // Every frame is a complete stream, plus 20 bytes of index per frame and a 20 byte footer.
+   const size_t cmp_buf_size = (num_frames + 1) * (lzham_dll.lzham_compress_bound(frame_size) + 20);
+   std::vector<uint8> cmp_buf(cmp_buf_size);
+
+   size_t cmp_len = cmp_buf_size;
+   lzham_compress_status_t comp_status = lzham_dll.lzham_compress_framed_memory(&comp_params, frame_size, &cmp_buf[0], &cmp_len, pSrc, src_len, NULL);
+   if (comp_status != LZHAM_COMP_STATUS_SUCCESS)
+   {
+      print_error("Framed compression failed with status %i\n", comp_status);
+      return false;
+   }
+
+   printf("%u frames of %u bytes, compressed size: %u\n", (uint)num_frames, frame_size, (uint)cmp_len);
+
+   const uint8 *pCmp = &cmp_buf[0];
+
+   // The whole file, the first frame, a range crossing the first frame boundary, the last byte, an empty range, and a
+   // range running past the end.
+   if ((!test_range(lzham_dll, decomp_params, pCmp, cmp_len, pSrc, src_len, 0, src_len)) ||
+       (!test_range(lzham_dll, decomp_params, pCmp, cmp_len, pSrc, src_len, 0, frame_size)) ||
+       (!test_range(lzham_dll, decomp_params, pCmp, cmp_len, pSrc, src_len, my_min(static_cast<size_t>(frame_size - 100), src_len), 200)) ||
+       (!test_range(lzham_dll, decomp_params, pCmp, cmp_len, pSrc, src_len, src_len ? (src_len - 1) : 0, 1)) ||
+       (!test_range(lzham_dll, decomp_params, pCmp, cmp_len, pSrc, src_len, src_len / 2, 0)) ||
+       (!test_range(lzham_dll, decomp_params, pCmp, cmp_len, pSrc, src_len, src_len - my_min(src_len, static_cast<size_t>(100)), 1000)))
+   {
+      return false;
+   }
+
+   // Offsets past the end of the data must be rejected.
+   uint8 dst_byte = 0;
+   size_t dst_len = 1;
+   lzham_decompress_status_t decomp_status = lzham_dll.lzham_decompress_range(&decomp_params, &dst_byte, &dst_len, pCmp, cmp_len, static_cast<lzham_uint64>(src_len) + 1);
+   if (decomp_status != LZHAM_DECOMP_STATUS_INVALID_PARAMETER)
+   {
+      print_error("Decoding past the end of the data returned status %i\n", decomp_status);
+      return false;
+   }
+
+   printf("Success\n");
+
+   return true;
+}
+
+// Compresses a whole buffer with lzham_compress(), passing at most piece_size bytes of input per call.
+static bool compress_stream(ilzham &lzham_dll, lzham_compress_state_ptr pState, const uint8 *pSrc, size_t src_len, size_t piece_size, std::vector<uint8> &cmp_buf)
+{
+   cmp_buf.resize(0);
+
+   size_t src_ofs = 0;
+   for ( ; ; )
+   {
+      uint8 out_buf[4096];
+      size_t in_size = my_min(piece_size, src_len - src_ofs);
+      size_t out_size = sizeof(out_buf);
+      const bool no_more_input = ((src_ofs + in_size) == src_len);
+
+      lzham_compress_status_t status = lzham_dll.lzham_compress(pState, pSrc + src_ofs, &in_size, out_buf, &out_size, no_more_input);
+
+      src_ofs += in_size;
+      cmp_buf.insert(cmp_buf.end(), out_buf, out_buf + out_size);
+
+      if (status >= LZHAM_COMP_STATUS_FIRST_SUCCESS_OR_FAILURE_CODE)
+      {
+         if (status != LZHAM_COMP_STATUS_SUCCESS)
+            print_error("Streaming compression failed with status %i\n", status);
+         return status == LZHAM_COMP_STATUS_SUCCESS;
+      }
+   }
+}
+
+// Passes compressed bytes to lzham_decompress() and appends all the output it can return. Stops once the stream has
+// ended or failed, or all the input has been consumed and more is needed.
+static lzham_decompress_status_t decompress_stream(ilzham &lzham_dll, lzham_decompress_state_ptr pState, const uint8 *pCmp, size_t cmp_len, bool no_more_input, std::vector<uint8> &dst_buf)
+{
+   size_t cmp_ofs = 0;
+   for ( ; ; )
+   {
+      uint8 out_buf[4096];
+      size_t in_size = cmp_len - cmp_ofs;
+      size_t out_size = sizeof(out_buf);
+
+      lzham_decompress_status_t status = lzham_dll.lzham_decompress(pState, pCmp + cmp_ofs, &in_size, out_buf, &out_size, no_more_input);
+
+      cmp_ofs += in_size;
+      dst_buf.insert(dst_buf.end(), out_buf, out_buf + out_size);
+
+      if (status >= LZHAM_DECOMP_STATUS_FIRST_SUCCESS_OR_FAILURE_CODE)
+         return status;
+
+      if ((status == LZHAM_DECOMP_STATUS_NEEDS_MORE_INPUT) && (cmp_ofs == cmp_len))
+         return status;
+   }
+}
+
+static bool compare_test_data(const char *pWhat, const std::vector<uint8> &buf, const uint8 *pExpected, size_t expected_len)
+{
+   if ((buf.size() != expected_len) || ((expected_len) && (memcmp(&buf[0], pExpected, expected_len))))
+   {
+      print_error("%s: %u bytes don't match the expected %u bytes\n", pWhat, (uint)buf.size(), (uint)expected_len);
+      return false;
+   }
+
+   return true;
+}
+
+// A reset compressor or decompressor must behave exactly like a new one: however it was used before, the same input
+// must give byte identical output.
+static bool test_reset(ilzham &lzham_dll, const uint8 *pSrc, size_t src_len, const comp_options &options)
+{
+   printf("Testing: Compressor and decompressor reset\n");
+
+   lzham_compress_params comp_params;
+   lzham_decompress_params decomp_params;
+   init_test_params(options, src_len, comp_params, decomp_params);
+
+   // Output is only repeatable with helper threads when parsing is deterministic.
+   comp_params.m_compress_flags |= LZHAM_COMP_FLAG_DETERMINISTIC_PARSING;
+
+   // Other data to leave behind in the states' dictionaries and models: the source reversed.
+   std::vector<uint8> other_buf(my_max(static_cast<size_t>(1), src_len));
+   for (size_t i = 0; i < src_len; i++)
+      other_buf[i] = pSrc[src_len - 1 - i];
+
+   // The output of new compressors, to compare against.
+   const size_t cmp_buf_size = lzham_dll.lzham_compress_bound(src_len);
+   std::vector<uint8> ref_cmp(cmp_buf_size);
+   size_t ref_cmp_len = cmp_buf_size;
+   lzham_compress_status_t comp_status = lzham_dll.lzham_compress_memory(&comp_params, &ref_cmp[0], &ref_cmp_len, pSrc, src_len, NULL);
+   if (comp_status != LZHAM_COMP_STATUS_SUCCESS)
+   {
+      print_error("Compression failed with status %i\n", comp_status);
+      return false;
+   }
+   ref_cmp.resize(ref_cmp_len);
+
+   std::vector<uint8> ref_stream;
+   lzham_compress_state_ptr pComp = lzham_dll.lzham_compress_init(&comp_params);
+   if (!pComp)
+   {
+      print_error("Failed initializing compressor!\n");
+      return false;
+   }
+   bool succeeded = compress_stream(lzham_dll, pComp, pSrc, src_len, 65536, ref_stream);
+   lzham_dll.lzham_compress_deinit(pComp);
+   if (!succeeded)
+      return false;
+
+   pComp = lzham_dll.lzham_compress_init(&comp_params);
+   if (!pComp)
+   {
+      print_error("Failed initializing compressor!\n");
+      return false;
+   }
+
+   // The source, the other data, then the source again, all through one compressor.
+   std::vector<uint8> cmp_buf(cmp_buf_size);
+   std::vector<uint8> other_cmp;
+   for (uint pass = 0; (succeeded) && (pass < 3); pass++)
+   {
+      const uint8 *pData = (pass == 1) ? &other_buf[0] : pSrc;
+      size_t cmp_len = cmp_buf_size;
+      comp_status = lzham_dll.lzham_compress_memory_with_state(pComp, &cmp_buf[0], &cmp_len, pData, src_len, NULL);
+      if (comp_status != LZHAM_COMP_STATUS_SUCCESS)
+      {
+         print_error("lzham_compress_memory_with_state() failed with status %i\n", comp_status);
+         succeeded = false;
+      }
+      else if (pass == 1)
+         other_cmp.assign(&cmp_buf[0], &cmp_buf[0] + cmp_len);
+      else if ((cmp_len != ref_cmp.size()) || (memcmp(&cmp_buf[0], &ref_cmp[0], cmp_len)))
+      {
+         print_error("Pass %u of lzham_compress_memory_with_state() differs from a new compressor's output\n", pass);
+         succeeded = false;
+      }
+   }
+
+   // Abandon a stream halfway, then reset and compress the source again.
+   if (succeeded)
+   {
+      uint8 out_buf[4096];
+      size_t in_size = src_len / 2;
+      size_t out_size = sizeof(out_buf);
+      lzham_dll.lzham_compress(pComp, &other_buf[0], &in_size, out_buf, &out_size, false);
+
+      std::vector<uint8> stream_buf;
+      if (!lzham_dll.lzham_compress_reset(pComp))
+      {
+         print_error("lzham_compress_reset() failed!\n");
+         succeeded = false;
+      }
+      else if (!compress_stream(lzham_dll, pComp, pSrc, src_len, 65536, stream_buf))
+         succeeded = false;
+      else if (stream_buf != ref_stream)
+      {
+         print_error("Streaming compression after lzham_compress_reset() differs from a new compressor's output\n");
+         succeeded = false;
+      }
+   }
+
+   lzham_dll.lzham_compress_deinit(pComp);
+
+   if (!succeeded)
+      return false;
+
+   lzham_decompress_state_ptr pDecomp = lzham_dll.lzham_decompress_init(&decomp_params);
+   if (!pDecomp)
+   {
+      print_error("Failed initializing decompressor!\n");
+      return false;
+   }
+
+   std::vector<uint8> dst_buf(my_max(static_cast<size_t>(1), src_len));
+   for (uint pass = 0; (succeeded) && (pass < 3); pass++)
+   {
+      const std::vector<uint8> &data_cmp = (pass == 1) ? other_cmp : ref_cmp;
+      size_t dst_len = src_len;
+      lzham_decompress_status_t decomp_status = lzham_dll.lzham_decompress_memory_with_state(pDecomp, &dst_buf[0], &dst_len, &data_cmp[0], data_cmp.size(), NULL);
+      if ((decomp_status != LZHAM_DECOMP_STATUS_SUCCESS) || (dst_len != src_len) || (memcmp(&dst_buf[0], (pass == 1) ? &other_buf[0] : pSrc, src_len)))
+      {
+         print_error("Pass %u of lzham_decompress_memory_with_state() failed (status %i)\n", pass, decomp_status);
+         succeeded = false;
+      }
+   }
+
+   // Abandon a stream halfway, then reset and decompress the streamed source.
+   if (succeeded)
+   {
+      std::vector<uint8> stream_buf;
+      decompress_stream(lzham_dll, pDecomp, &other_cmp[0], other_cmp.size() / 2, false, stream_buf);
+
+      stream_buf.resize(0);
+      if (!lzham_dll.lzham_decompress_reset(pDecomp))
+      {
+         print_error("lzham_decompress_reset() failed!\n");
+         succeeded = false;
+      }
+      else
+      {
+         lzham_decompress_status_t decomp_status = decompress_stream(lzham_dll, pDecomp, &ref_stream[0], ref_stream.size(), true, stream_buf);
+         if (decomp_status != LZHAM_DECOMP_STATUS_SUCCESS)
+         {
+            print_error("Streaming decompression after lzham_decompress_reset() failed with status %i\n", decomp_status);
+            succeeded = false;
+         }
+         else if (!compare_test_data("Streaming decompression after lzham_decompress_reset()", stream_buf, pSrc, src_len))
+            succeeded = false;
+      }
+   }
+
+   lzham_dll.lzham_decompress_deinit(pDecomp);
+
+   if (succeeded)
+      printf("Success\n");
+
+   return succeeded;
+}
+
+// The source is fed to lzham_compress2() in pieces of varying size, each followed by a sync or full flush. After every
+// flush, a decompressor given only the output so far must return all of the input so far.
+static bool test_flush(ilzham &lzham_dll, const uint8 *pSrc, size_t src_len, const comp_options &options)
+{
+   printf("Testing: Streaming compression with flushes\n");
+
+   lzham_compress_params comp_params;
+   lzham_decompress_params decomp_params;
+   init_test_params(options, src_len, comp_params, decomp_params);
+
+   lzham_compress_state_ptr pComp = lzham_dll.lzham_compress_init(&comp_params);
+   lzham_decompress_state_ptr pDecomp = lzham_dll.lzham_decompress_init(&decomp_params);
+   if ((!pComp) || (!pDecomp))
+   {
+      print_error("Failed initializing compressor or decompressor!\n");
+      if (pComp)
+         lzham_dll.lzham_compress_deinit(pComp);
+      if (pDecomp)
+         lzham_dll.lzham_decompress_deinit(pDecomp);
+      return false;
+   }
+
+   static const size_t s_piece_sizes[] = { 1, 3, 1000, 4096, 33333, 196608 };
+   const uint cNumPieceSizes = sizeof(s_piece_sizes) / sizeof(s_piece_sizes[0]);
+
+   std::vector<uint8> cmp_buf;
+   std::vector<uint8> dst_buf;
+   size_t cmp_decoded_ofs = 0;
+   size_t src_ofs = 0;
+   uint num_flushes = 0;
+   bool succeeded = true;
+
+   for (uint piece_index = 0; succeeded; piece_index++)
+   {
+      const size_t piece_len = my_min(s_piece_sizes[piece_index % cNumPieceSizes], src_len - src_ofs);
+      const bool last_piece = ((src_ofs + piece_len) == src_len);
+      const lzham_flush_t flush_type = last_piece ? LZHAM_FLUSH_FINISH : ((piece_index & 1) ? LZHAM_FLUSH_FULL : LZHAM_FLUSH_SYNC);
+
+      // Keep calling with the same flush mode until the flush (or the stream) is complete.
+      lzham_compress_status_t comp_status;
+      size_t piece_ofs = 0;
+      for ( ; ; )
+      {
+         uint8 out_buf[4096];
+         size_t in_size = piece_len - piece_ofs;
+         size_t out_size = sizeof(out_buf);
+
+         comp_status = lzham_dll.lzham_compress2(pComp, pSrc + src_ofs + piece_ofs, &in_size, out_buf, &out_size, flush_type);
+
+         piece_ofs += in_size;
+         cmp_buf.insert(cmp_buf.end(), out_buf, out_buf + out_size);
+
+         if (comp_status >= LZHAM_COMP_STATUS_FIRST_SUCCESS_OR_FAILURE_CODE)
+            break;
+         if ((comp_status == LZHAM_COMP_STATUS_NEEDS_MORE_INPUT) && (piece_ofs == piece_len))
+            break;
+      }
+
+      src_ofs += piece_len;
+
+      if (last_piece ? (comp_status != LZHAM_COMP_STATUS_SUCCESS) : (comp_status != LZHAM_COMP_STATUS_NEEDS_MORE_INPUT))
+      {
+         print_error("lzham_compress2() returned status %i at offset %u\n", comp_status, (uint)src_ofs);
+         succeeded = false;
+         break;
+      }
+
+      lzham_decompress_status_t decomp_status = LZHAM_DECOMP_STATUS_NEEDS_MORE_INPUT;
+      if (cmp_buf.size() > cmp_decoded_ofs)
+      {
+         decomp_status = decompress_stream(lzham_dll, pDecomp, &cmp_buf[0] + cmp_decoded_ofs, cmp_buf.size() - cmp_decoded_ofs, last_piece, dst_buf);
+         cmp_decoded_ofs = cmp_buf.size();
+      }
+
+      if (decomp_status != (last_piece ? LZHAM_DECOMP_STATUS_SUCCESS : LZHAM_DECOMP_STATUS_NEEDS_MORE_INPUT))
+      {
+         print_error("Decompressing the flushed stream returned status %i at offset %u\n", decomp_status, (uint)src_ofs);
+         succeeded = false;
+      }
+      else if (!compare_test_data("Data decompressed after a flush", dst_buf, pSrc, src_ofs))
+         succeeded = false;
+
+      if (last_piece)
+         break;
+
+      num_flushes++;
+   }
+
+   lzham_dll.lzham_compress_deinit(pComp);
+   lzham_dll.lzham_decompress_deinit(pDecomp);
+
+   if (succeeded)
+   {
+      printf("%u flushes, compressed size: %u\n", num_flushes, (uint)cmp_buf.size());
+      printf("Success\n");
+   }
+
+   return succeeded;
+}
+
+// One compressor of the shared task pool test, run on its own thread.
+struct pool_test_job
+{
+   ilzham *m_pLzham_dll;
+   lzham_compress_params m_params;
+   const uint8 *m_pSrc;
+   size_t m_src_len;
+   size_t m_piece_size;
+   std::vector<uint8> m_cmp_buf;
+   bool m_succeeded;
+};
+
+static void run_pool_test_job(pool_test_job &job)
+{
+   lzham_compress_state_ptr pComp = job.m_pLzham_dll->lzham_compress_init(&job.m_params);
+   job.m_succeeded = (pComp != NULL) && compress_stream(*job.m_pLzham_dll, pComp, job.m_pSrc, job.m_src_len, job.m_piece_size, job.m_cmp_buf);
+   if (pComp)
+      job.m_pLzham_dll->lzham_compress_deinit(pComp);
+}
+
+#if defined(WIN32) || defined(_XBOX)
+static unsigned __stdcall pool_test_thread_func(void *pData)
+{
+   run_pool_test_job(*static_cast<pool_test_job*>(pData));
+   return 0;
+}
+#else
+static void* pool_test_thread_func(void *pData)
+{
+   run_pool_test_job(*static_cast<pool_test_job*>(pData));
+   return NULL;
+}
+#endif
+
+// Several compressors run at once on one task pool (each feeding its input in different sized pieces), then their
+// outputs are decompressed. Done twice, so the pool is also reused by new compressors.
+static bool test_shared_pool(ilzham &lzham_dll, const uint8 *pSrc, size_t src_len, const comp_options &options)
+{
+   printf("Testing: Compressors sharing a task pool\n");
+
+   lzham_compress_params comp_params;
+   lzham_decompress_params decomp_params;
+   init_test_params(options, src_len, comp_params, decomp_params);
+
+   const uint num_pool_threads = my_max(2, options.m_max_helper_threads);
+   lzham_task_pool_ptr pPool = lzham_dll.lzham_create_task_pool(num_pool_threads);
+   if (!pPool)
+   {
+      print_error("Failed creating a task pool with %u threads!\n", num_pool_threads);
+      return false;
+   }
+
+   comp_params.m_pTask_pool = pPool;
+
+   const uint cNumJobs = 3;
+   pool_test_job jobs[cNumJobs];
+
+   bool succeeded = true;
+   for (uint round = 0; (succeeded) && (round < 2); round++)
+   {
+      for (uint i = 0; i < cNumJobs; i++)
+      {
+         jobs[i].m_pLzham_dll = &lzham_dll;
+         jobs[i].m_params = comp_params;
+         jobs[i].m_pSrc = pSrc;
+         jobs[i].m_src_len = src_len;
+         jobs[i].m_piece_size = static_cast<size_t>(4096) << (i * 4);
+         jobs[i].m_succeeded = false;
+      }
+
+      // The first job runs on this thread, the rest on their own.
+#if defined(WIN32) || defined(_XBOX)
+      HANDLE threads[cNumJobs];
+      for (uint i = 1; i < cNumJobs; i++)
+         threads[i] = (HANDLE)_beginthreadex(NULL, 0, pool_test_thread_func, &jobs[i], 0, NULL);
+#else
+      pthread_t threads[cNumJobs];
+      bool thread_started[cNumJobs];
+      for (uint i = 1; i < cNumJobs; i++)
+         thread_started[i] = (pthread_create(&threads[i], NULL, pool_test_thread_func, &jobs[i]) == 0);
+#endif
+
+      run_pool_test_job(jobs[0]);
+
+      for (uint i = 1; i < cNumJobs; i++)
+      {
+#if defined(WIN32) || defined(_XBOX)
+         if (threads[i])
+         {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+         }
+#else
+         if (thread_started[i])
+            pthread_join(threads[i], NULL);
+#endif
+      }
+
+      for (uint i = 0; (succeeded) && (i < cNumJobs); i++)
+      {
+         if (!jobs[i].m_succeeded)
+         {
+            print_error("Compressor %u of round %u failed!\n", i, round);
+            succeeded = false;
+            break;
+         }
+
+         std::vector<uint8> dst_buf(my_max(static_cast<size_t>(1), src_len));
+         size_t dst_len = src_len;
+         lzham_decompress_status_t status = lzham_dll.lzham_decompress_memory(&decomp_params, &dst_buf[0], &dst_len, &jobs[i].m_cmp_buf[0], jobs[i].m_cmp_buf.size(), NULL);
+         if ((status != LZHAM_DECOMP_STATUS_SUCCESS) || (dst_len != src_len) || (memcmp(&dst_buf[0], pSrc, src_len)))
+         {
+            print_error("Decompressing the output of compressor %u of round %u failed (status %i)\n", i, round, status);
+            succeeded = false;
+         }
+      }
+   }
+
+   lzham_dll.lzham_destroy_task_pool(pPool);
+
+   if (succeeded)
+      printf("Success\n");
+
+   return succeeded;
+}
+
+// Random bytes can't be compressed, so their compressed size is as close to lzham_compress_bound() as it gets.
+static bool test_bound(ilzham &lzham_dll, const comp_options &options)
+{
+   printf("Testing: Compressed size bound on random data\n");
+
+   static const size_t s_src_sizes[] = { 0, 1, 2, 100, 4096, 65535, 65536, 65537, 524288 + 3, 2 * 1024 * 1024 + 1 };
+   const size_t cNumSrcSizes = sizeof(s_src_sizes) / sizeof(s_src_sizes[0]);
+
+   std::vector<uint8> src_buf(s_src_sizes[cNumSrcSizes - 1]);
+   uint32 x = 0x9E3779B9;
+   for (size_t i = 0; i < src_buf.size(); i++)
+   {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      src_buf[i] = static_cast<uint8>(x >> 24);
+   }
+
+   std::vector<uint8> cmp_buf, dst_buf;
+
+   for (uint i = 0; i < cNumSrcSizes * 2; i++)
+   {
+      const size_t src_len = s_src_sizes[i >> 1];
+
+      lzham_compress_params comp_params;
+      lzham_decompress_params decomp_params;
+      init_test_params(options, src_len, comp_params, decomp_params);
+      if (i & 1)
+         comp_params.m_compress_flags |= LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS;
+
+      const size_t bound = lzham_dll.lzham_compress_bound(src_len);
+      if (bound <= src_len)
+      {
+         print_error("lzham_compress_bound() returned %u for %u bytes\n", (uint)bound, (uint)src_len);
+         return false;
+      }
+
+      // Exactly the bound, so overstepping it fails with LZHAM_COMP_STATUS_OUTPUT_BUF_TOO_SMALL.
+      cmp_buf.resize(bound);
+      size_t cmp_len = bound;
+      lzham_compress_status_t comp_status = lzham_dll.lzham_compress_memory(&comp_params, &cmp_buf[0], &cmp_len, &src_buf[0], src_len, NULL);
+      if ((comp_status != LZHAM_COMP_STATUS_SUCCESS) || (cmp_len > bound))
+      {
+         print_error("Compressing %u random bytes into %u bytes failed (status %i, %u bytes)\n", (uint)src_len, (uint)bound, comp_status, (uint)cmp_len);
+         return false;
+      }
+
+      dst_buf.resize(my_max(static_cast<size_t>(1), src_len));
+      size_t dst_len = src_len;
+      lzham_decompress_status_t decomp_status = lzham_dll.lzham_decompress_memory(&decomp_params, &dst_buf[0], &dst_len, &cmp_buf[0], cmp_len, NULL);
+      if ((decomp_status != LZHAM_DECOMP_STATUS_SUCCESS) || (dst_len != src_len) || ((src_len) && (memcmp(&dst_buf[0], &src_buf[0], src_len))))
+      {
+         print_error("Decompressing %u random bytes failed (status %i)\n", (uint)src_len, decomp_status);
+         return false;
+      }
+
+      printf("%u bytes%s: compressed size %u, bound %u\n", (uint)src_len, (i & 1) ? " (independent chunks)" : "", (uint)cmp_len, (uint)bound);
+   }
+
+   printf("Success\n");
+
+   return true;
+}
+
+// Memory callbacks that track the current and peak number of bytes allocated. Each block starts with a header holding
+// its size, which keeps the blocks LZHAM_MIN_ALLOC_ALIGNMENT aligned. Helper threads allocate too, so the counters are
+// locked.
+class tracking_allocator
+{
+public:
+   enum { cHeaderSize = LZHAM_MIN_ALLOC_ALIGNMENT };
+
+   tracking_allocator() : m_cur_size(0), m_peak_size(0)
+   {
+#if defined(WIN32) || defined(_XBOX)
+      InitializeCriticalSection(&m_lock);
+#else
+      pthread_mutex_init(&m_lock, NULL);
+#endif
+   }
+
+   ~tracking_allocator()
+   {
+#if defined(WIN32) || defined(_XBOX)
+      DeleteCriticalSection(&m_lock);
+#else
+      pthread_mutex_destroy(&m_lock);
+#endif
+   }
+
+   // Starts a new measurement from the bytes allocated right now.
+   void reset_peak()
+   {
+      lock();
+      m_peak_size = m_cur_size;
+      unlock();
+   }
+
+   uint64 get_cur_size() { lock(); uint64 size = m_cur_size; unlock(); return size; }
+   uint64 get_peak_size() { lock(); uint64 size = m_peak_size; unlock(); return size; }
+
+   static void* realloc_func(void* p, size_t size, size_t* pActual_size, bool movable, void* pUser_data)
+   {
+      tracking_allocator *pAllocator = static_cast<tracking_allocator*>(pUser_data);
+
+      size_t old_size = 0;
+      if (p)
+      {
+         p = static_cast<uint8*>(p) - cHeaderSize;
+         old_size = *static_cast<size_t*>(p);
+      }
+
+      uint8 *pNew_block = NULL;
+      if (!size)
+      {
+         free(p);
+      }
+      else if ((!p) || (movable))
+      {
+         pNew_block = static_cast<uint8*>(realloc(p, cHeaderSize + size));
+         if (pNew_block)
+            *reinterpret_cast<size_t*>(pNew_block) = size;
+      }
+
+      // A failed or refused realloc leaves the old block as it was.
+      size_t new_size = (pNew_block) ? size : ((size) ? old_size : 0);
+      if (pActual_size)
+         *pActual_size = new_size;
+
+      pAllocator->lock();
+      pAllocator->m_cur_size = pAllocator->m_cur_size - old_size + new_size;
+      pAllocator->m_peak_size = my_max(pAllocator->m_peak_size, pAllocator->m_cur_size);
+      pAllocator->unlock();
+
+      return pNew_block ? (pNew_block + cHeaderSize) : NULL;
+   }
+
+   static size_t msize_func(void* p, void* pUser_data)
+   {
+      (void)pUser_data;
+      return p ? *reinterpret_cast<size_t*>(static_cast<uint8*>(p) - cHeaderSize) : 0;
+   }
+
+private:
+#if defined(WIN32) || defined(_XBOX)
+   CRITICAL_SECTION m_lock;
+   void lock() { EnterCriticalSection(&m_lock); }
+   void unlock() { LeaveCriticalSection(&m_lock); }
+#else
+   pthread_mutex_t m_lock;
+   void lock() { pthread_mutex_lock(&m_lock); }
+   void unlock() { pthread_mutex_unlock(&m_lock); }
+#endif
+
+   uint64 m_cur_size;
+   uint64 m_peak_size;
+};
+
+// Compares the memory estimates with the peak the memory callbacks see while compressing and decompressing the file. The
+// estimates must cover the peak, without being far above it.
+static bool test_memory_estimates(ilzham &lzham_dll, const uint8 *pSrc, size_t src_len, const comp_options &options)
+{
+   printf("Testing: Memory estimates\n");
+
+   const lzham_compress_level levels[2] = { LZHAM_COMP_LEVEL_FASTEST, options.m_comp_level };
+   const uint helper_counts[2] = { 0, static_cast<uint>(my_max(2, options.m_max_helper_threads)) };
+
+   tracking_allocator allocator;
+   lzham_dll.lzham_set_memory_callbacks(tracking_allocator::realloc_func, tracking_allocator::msize_func, &allocator);
+
+   std::vector<uint8> cmp_buf, dst_buf;
+
+   bool succeeded = true;
+   for (uint i = 0; (succeeded) && (i < 4); i++)
+   {
+      lzham_compress_params comp_params;
+      lzham_decompress_params decomp_params;
+      init_test_params(options, src_len, comp_params, decomp_params);
+      comp_params.m_level = levels[i >> 1];
+      comp_params.m_max_helper_threads = helper_counts[i & 1];
+
+      const uint64 comp_estimate = lzham_dll.lzham_compress_get_memory_requirements(&comp_params);
+      const uint64 decomp_estimate = lzham_dll.lzham_decompress_get_memory_requirements(&decomp_params);
+
+      allocator.reset_peak();
+      const uint64 base_size = allocator.get_cur_size();
+
+      lzham_compress_state_ptr pComp = lzham_dll.lzham_compress_init(&comp_params);
+      succeeded = (pComp != NULL) && compress_stream(lzham_dll, pComp, pSrc, src_len, 65536, cmp_buf);
+      if (pComp)
+         lzham_dll.lzham_compress_deinit(pComp);
+
+      const uint64 comp_peak = allocator.get_peak_size() - base_size;
+
+      allocator.reset_peak();
+
+      lzham_decompress_state_ptr pDecomp = NULL;
+      if (succeeded)
+      {
+         pDecomp = lzham_dll.lzham_decompress_init(&decomp_params);
+         dst_buf.resize(0);
+         succeeded = (pDecomp != NULL) && (decompress_stream(lzham_dll, pDecomp, &cmp_buf[0], cmp_buf.size(), true, dst_buf) == LZHAM_DECOMP_STATUS_SUCCESS) && (dst_buf.size() == src_len);
+         if (pDecomp)
+            lzham_dll.lzham_decompress_deinit(pDecomp);
+      }
+
+      const uint64 decomp_peak = allocator.get_peak_size() - base_size;
+
+      if (!succeeded)
+      {
+         print_error("Compressing or decompressing at level %u with %u helpers failed!\n", comp_params.m_level, comp_params.m_max_helper_threads);
+         break;
+      }
+
+      printf("Level %u, %u helpers: compressor peak " QUAD_INT_FMT ", estimate " QUAD_INT_FMT "; decompressor peak " QUAD_INT_FMT ", estimate " QUAD_INT_FMT "\n",
+         comp_params.m_level, comp_params.m_max_helper_threads, comp_peak, comp_estimate, decomp_peak, decomp_estimate);
+
+      // The compressor's estimate is a bound, which buffers a small file never fills can keep well above the peak.
+      if ((comp_peak > comp_estimate) || (comp_estimate > comp_peak * 2) || (decomp_peak > decomp_estimate) || (decomp_estimate > decomp_peak * 2))
+      {
+         print_error("The memory estimates are too far from the peak usage!\n");
+         succeeded = false;
+      }
+   }
+
+   lzham_dll.lzham_set_memory_callbacks(NULL, NULL, NULL);
+
+   if ((succeeded) && (allocator.get_cur_size()))
+   {
+      print_error(QUAD_INT_FMT " bytes are still allocated!\n", allocator.get_cur_size());
+      succeeded = false;
+   }
+
+   if (succeeded)
+      printf("Success\n");
+
+   return succeeded;
+}
+
+static bool test_api(ilzham &lzham_dll, const char* pSrc_filename, const comp_options &options)
+{
+   std::vector<uint8> src_buf;
+   size_t src_len = 0;
+   if (!read_test_file(pSrc_filename, src_buf, src_len))
+      return false;
+
+   printf("Testing API on file \"%s\" (%u bytes)\n", pSrc_filename, (uint)src_len);
+
+   const uint8 *pSrc = &src_buf[0];
+
+   if (!test_framed(lzham_dll, pSrc, src_len, options))
+      return false;
+
+   if (!test_reset(lzham_dll, pSrc, src_len, options))
+      return false;
+
+   if (!test_shared_pool(lzham_dll, pSrc, src_len, options))
+      return false;
+
+   if (!test_flush(lzham_dll, pSrc, src_len, options))
+      return false;
+
+   if (!test_bound(lzham_dll, options))
+      return false;
+
+   if (!test_memory_estimates(lzham_dll, pSrc, src_len, options))
+      return false;
+
+   printf("All API tests succeeded.\n");
+
+   return true;
+}
+
+int main_internal(string_array cmd_line, int num_helper_threads, ilzham &lzham_dll)
+{
+   comp_options options;
+   options.m_max_helper_threads = num_helper_threads;
+
+#ifdef _XBOX
+   options.m_dict_size_log2 = 21;
+#endif
+
+   if (!cmd_line.size())
+   {
+      print_usage();
+      return simple_test(lzham_dll, options);
+   }
+
+   enum op_mode_t
+   {
+      OP_MODE_INVALID = -1,
+      OP_MODE_COMPRESS = 0,
+      OP_MODE_DECOMPRESS = 1,
+      OP_MODE_ALL = 2,
+      OP_MODE_TEST = 3
+   };
+
+   op_mode_t op_mode = OP_MODE_INVALID;
+
+   for (int i = 0; i < (int)cmd_line.size(); i++)
+   {
+      const std::string &str = cmd_line[i];
+      if (str[0] == '-')
+      {
+         if (str.size() < 2)
+         {
+            print_error("Invalid option: %s\n", str.c_str());
+            return EXIT_FAILURE;
+         }
+         switch (tolower(str[1]))
+         {
+            case 'u':
+            {
+               options.m_unbuffered_decompression = true;
+               break;
+            }
+            case 'd':
+            {
+               int dict_size = atoi(str.c_str() + 2);
+               if ((dict_size < LZHAM_MIN_DICT_SIZE_LOG2) || (dict_size > LZHAMTEST_MAX_POSSIBLE_DICT_SIZE))
+               {
+                  print_error("Invalid dictionary size: %s\n", str.c_str());
+                  return EXIT_FAILURE;
+               }
+               options.m_dict_size_log2 = dict_size;
+               break;
+            }
+            case 'm':
+            {
+               int comp_level = atoi(str.c_str() + 2);
+               if ((comp_level < 0) || (comp_level > (int)LZHAM_COMP_LEVEL_UBER))
+               {
+                  print_error("Invalid compression level: %s\n", str.c_str());
+                  return EXIT_FAILURE;
+               }
+               options.m_comp_level = static_cast<lzham_compress_level>(comp_level);
+               break;
+            }
+            case 't':
+            {
+               int num_threads = atoi(str.c_str() + 2);
+               if ((num_threads < 0) || (num_threads > LZHAM_MAX_HELPER_THREADS))
+               {
+                  print_error("Invalid number of helper threads: %s\n", str.c_str());
+                  return EXIT_FAILURE;
+               }
+               options.m_max_helper_threads = num_threads;
+               break;
+            }
+            case 'c':
+            {
+               options.m_compute_adler32_during_decomp = false;
+               break;
+            }
+            case 'v':
+            {
+               options.m_verify_compressed_data = true;
+               break;
+            }
+            case 'r':
+            {
+               options.m_randomize_params = true;
+               break;
+            }
+            case 'p':
+            {
+               options.m_force_polar_codes = true;
+               break;
+            }
+            case 'x':
+            {
+               options.m_extreme_parsing = true;
+               break;
+            }
+            case 'e':
+            {
+               options.m_deterministic_parsing = true;
+               break;
+            }
+            case 'i':
+            {
+               options.m_independent_chunks = true;
+               break;
+            }
+            case 'l':
+            {
+               options.m_huge_pages = true;
+               break;
+            }
+            case 'f':
+            {
+               options.m_long_distance_matching = true;
+               break;
+            }
+            case 'a':
+            {
+               if (str.size() == 2)
+               {
+                  options.m_helpers_share_cache = true;
+                  break;
+               }
+
+               const char *p = str.c_str() + 2;
+               for ( ; ; )
+               {
+                  if ((*p < '0') || (*p > '9'))
+                  {
+                     print_error("Invalid CPU list: %s\n", str.c_str());
+                     return EXIT_FAILURE;
+                  }
+
+                  char *pEnd;
+                  options.m_helper_cpus.push_back(static_cast<lzham_uint32>(strtoul(p, &pEnd, 10)));
+                  p = pEnd;
+                  if (!*p)
+                     break;
+                  if (*p++ != ',')
+                  {
+                     print_error("Invalid CPU list: %s\n", str.c_str());
+                     return EXIT_FAILURE;
+                  }
+               }
+               break;
+            }
+            case 's':
+            {
+               int seed = atoi(str.c_str() + 2);
+               srand(seed);
+               printf("Using random seed: %i\n", seed);
+               break;
+            }
+            default:
+            {
+               print_error("Invalid option: %s\n", str.c_str());
+               return EXIT_FAILURE;
+            }
+         }
+
+         cmd_line.erase(cmd_line.begin() + i);
+         i--;
+
+         continue;
+      }
+
+      if (str.size() != 1)
+      {
+         print_error("Invalid mode: %s\n", str.c_str());
          return EXIT_FAILURE;
       }
       switch (tolower(str[0]))
@@ -1190,6 +2264,11 @@ int main_internal(string_array cmd_line, int num_helper_threads, ilzham &lzham_d
             op_mode = OP_MODE_ALL;
             break;
          }
+         case 't':
+         {
+            op_mode = OP_MODE_TEST;
+            break;
+         }
          default:
          {
             print_error("Invalid mode: %s\n", str.c_str());
@@ -1231,7 +2310,7 @@ int main_internal(string_array cmd_line, int num_helper_threads, ilzham &lzham_d
          const std::string &src_file = cmd_line[0];
          const std::string &cmp_file = cmd_line[1];
 
-         bool comp_result = compress_streaming(lzham_dll, src_file.c_str(), cmp_file.c_str(), options);
+         bool comp_result = options.m_independent_chunks ? compress_memory(lzham_dll, src_file.c_str(), cmp_file.c_str(), options) : compress_streaming(lzham_dll, src_file.c_str(), cmp_file.c_str(), options);
          if (comp_result)
             exit_status = EXIT_SUCCESS;
 
@@ -1299,6 +2378,22 @@ int main_internal(string_array cmd_line, int num_helper_threads, ilzham &lzham_d
             exit_status = EXIT_SUCCESS;
          break;
       }
+      case OP_MODE_TEST:
+      {
+         if (!cmd_line.size())
+         {
+            print_error("No file specified!\n");
+            return EXIT_FAILURE;
+         }
+         else if (cmd_line.size() != 1)
+         {
+            print_error("Too many filenames!\n");
+            return EXIT_FAILURE;
+         }
+         if (test_api(lzham_dll, cmd_line[0].c_str(), options))
+            exit_status = EXIT_SUCCESS;
+         break;
+      }
       default:
       {
          print_error("No mode specified!\n");
@@ -15,14 +15,26 @@ public:
    {
       this->lzham_get_version = ::lzham_get_version;
       this->lzham_set_memory_callbacks = ::lzham_set_memory_callbacks;
+      this->lzham_create_task_pool = ::lzham_create_task_pool;
+      this->lzham_destroy_task_pool = ::lzham_destroy_task_pool;
       this->lzham_compress_init = ::lzham_compress_init;
       this->lzham_compress_deinit = ::lzham_compress_deinit;
       this->lzham_compress = ::lzham_compress;
+      this->lzham_compress2 = ::lzham_compress2;
+      this->lzham_compress_reset = ::lzham_compress_reset;
+      this->lzham_compress_bound = ::lzham_compress_bound;
+      this->lzham_compress_get_memory_requirements = ::lzham_compress_get_memory_requirements;
       this->lzham_compress_memory = ::lzham_compress_memory;
+      this->lzham_compress_memory_with_state = ::lzham_compress_memory_with_state;
+      this->lzham_compress_framed_memory = ::lzham_compress_framed_memory;
       this->lzham_decompress_init = ::lzham_decompress_init;
       this->lzham_decompress_deinit = ::lzham_decompress_deinit;
       this->lzham_decompress = ::lzham_decompress;
+      this->lzham_decompress_reset = ::lzham_decompress_reset;
+      this->lzham_decompress_get_memory_requirements = ::lzham_decompress_get_memory_requirements;
       this->lzham_decompress_memory = ::lzham_decompress_memory;
+      this->lzham_decompress_memory_with_state = ::lzham_decompress_memory_with_state;
+      this->lzham_decompress_range = ::lzham_decompress_range;
       return true;
    }
    
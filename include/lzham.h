@@ -5,7 +5,7 @@
 
 // Upper byte = major version
 // Lower byte = minor version
-#define LZHAM_DLL_VERSION        0x1006
+#define LZHAM_DLL_VERSION        0x1011
 
 #ifdef LZHAM_EXPORTS
    #define LZHAM_DLL_EXPORT __declspec(dllexport)
@@ -19,6 +19,7 @@ extern "C" {
 
    typedef unsigned char   lzham_uint8;
    typedef unsigned int    lzham_uint32;
+   typedef unsigned long long lzham_uint64;
    typedef unsigned int    lzham_bool;
 
    // Returns DLL version.
@@ -39,7 +40,7 @@ extern "C" {
    #define LZHAM_MAX_DICT_SIZE_LOG2_X86 26
    #define LZHAM_MAX_DICT_SIZE_LOG2_X64 29
 
-   #define LZHAM_MAX_HELPER_THREADS 16
+   #define LZHAM_MAX_HELPER_THREADS 128
 
    enum lzham_compress_status_t
    {
@@ -59,6 +60,25 @@ extern "C" {
       LZHAM_COMP_STATUS_FORCE_DWORD = 0xFFFFFFFF
    };
 
+   // Flush modes for lzham_compress2().
+   enum lzham_flush_t
+   {
+      LZHAM_FLUSH_NONE = 0,
+
+      // Codes all input passed in so far and ends the block early, byte aligned, so the decompressor can return every
+      // byte of it without waiting for more input. Costs a few bytes plus a partially filled block per flush.
+      LZHAM_FLUSH_SYNC,
+
+      // Like LZHAM_FLUSH_SYNC, but also resets the statistical models, so the blocks that follow don't depend on the
+      // adaptive coding state of earlier ones. The dictionary is kept, so matches may still reach back across the flush.
+      LZHAM_FLUSH_FULL,
+
+      // Same as passing no_more_input_bytes_flag=true to lzham_compress().
+      LZHAM_FLUSH_FINISH,
+
+      LZHAM_FLUSH_FORCE_DWORD = 0xFFFFFFFF
+   };
+
    enum lzham_compress_level
    {
       LZHAM_COMP_LEVEL_FASTEST = 0,
@@ -72,13 +92,52 @@ extern "C" {
       LZHAM_COMP_LEVEL_FORCE_DWORD = 0xFFFFFFFF
    };
 
+   // Pool of helper threads which may be shared by any number of compressors (see lzham_compress_params::m_pTask_pool),
+   // so a process running many compressors at once doesn't oversubscribe its cores or create threads on every call.
+   // Queued work from all compressors is executed in submission order. Destroy the pool only after every compressor
+   // using it has been deinitialized.
+   typedef void *lzham_task_pool_ptr;
+   LZHAM_DLL_EXPORT lzham_task_pool_ptr lzham_create_task_pool(lzham_uint32 num_threads);
+   LZHAM_DLL_EXPORT void lzham_destroy_task_pool(lzham_task_pool_ptr pPool);
+
+   // Allocation policy for the largest buffers: the dictionary, and the compressor's match finder tables. These are read
+   // at random, so with big dictionaries much of the time goes to TLB misses, which huge pages mostly avoid. Set in
+   // m_alloc_policy of lzham_compress_params or lzham_decompress_params (0=allocate through the memory callbacks).
+   enum lzham_alloc_policy_flags
+   {
+      // Allocate these buffers directly from the OS, backed by huge pages where possible: transparent huge pages on Linux
+      // (mmap() + madvise(MADV_HUGEPAGE)), large pages on Windows if the process holds SeLockMemoryPrivilege.
+      LZHAM_ALLOC_POLICY_HUGE_PAGES = 1,
+
+      // Allocate these buffers directly from the OS, preferably from the memory of NUMA node m_numa_node. Bind the
+      // calling threads (and the helper threads) to the same node to make the most of it. Linux and Windows only.
+      LZHAM_ALLOC_POLICY_NUMA_NODE = 2
+   };
+
    // streaming (zlib-like) interface
    typedef void *lzham_compress_state_ptr;
    enum lzham_compress_flags
    {
       LZHAM_COMP_FLAG_FORCE_POLAR_CODING = 1,
       LZHAM_COMP_FLAG_EXTREME_PARSING = 2,
-      LZHAM_COMP_FLAG_DETERMINISTIC_PARSING = 4
+      LZHAM_COMP_FLAG_DETERMINISTIC_PARSING = 4,
+
+      // lzham_compress_memory() only: splits the source into independent chunks of max(4MB, dictionary size) bytes and
+      // compresses them in parallel, one chunk per helper thread (plus the caller). Matches never cross a chunk boundary and
+      // each chunk starts with freshly reset models, which typically costs a few percent of ratio on redundant data in
+      // exchange for throughput that scales with the number of threads. Each worker needs its own compressor, so memory
+      // use grows with the thread count. Requires a decompressor which understands reset blocks (DLL version 0x1007+).
+      LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS = 8,
+
+      // Adds a long distance matching pass: a rolling hash finds long repeats anywhere in the dictionary, which the match
+      // finder's few probes at the lower levels tend to miss. Helps most on large inputs with big repeated regions (backups,
+      // disk images). Costs about 4 bytes of memory per 64 bytes of dictionary (up to 16MB). The stream format is unchanged.
+      LZHAM_COMP_FLAG_LONG_DISTANCE_MATCHING = 16,
+
+      // Runs the helper threads only on the CPUs sharing the last level cache (usually the L3) with the thread that calls
+      // lzham_compress_init() or lzham_compress_memory(), so the match finder's tables stay in one cache and on one socket.
+      // Ignored if m_num_helper_cpus is set, or if the topology is unknown (it's only looked up on Linux and Windows).
+      LZHAM_COMP_FLAG_HELPERS_SHARE_CACHE = 32
    };
 
    struct lzham_compress_params
@@ -90,6 +149,34 @@ extern "C" {
       lzham_uint32 m_cpucache_total_lines;
       lzham_uint32 m_cpucache_line_size;
       lzham_uint32 m_compress_flags;
+
+      // Optional pool created by lzham_create_task_pool(). If set, helper work runs on it instead of on threads owned by
+      // this compressor, and m_max_helper_threads limits how many of its threads this compressor uses (0=all of them).
+      lzham_task_pool_ptr m_pTask_pool;
+
+      // Optional preset dictionary: the first bytes of each stream may match against it, which helps a lot on small
+      // inputs that resemble each other (messages, records). Only its last 2^m_dict_size_log2 bytes are used. The
+      // decompressor must be given the same bytes. The buffer must remain valid until the compressor is deinitialized.
+      lzham_uint32 m_num_seed_bytes;
+      const void *m_pSeed_bytes;
+
+      // Optional throughput target in KB per second (0=disabled). m_level becomes the highest effort used: after each
+      // block the time spent so far is compared against the time the target allows for the bytes compressed so far, and
+      // the match finder and parser effort of the following blocks is lowered (down to LZHAM_COMP_LEVEL_FASTEST) or raised
+      // again to fit. To meet a deadline, pass the input size divided by the allowed time. Only wall clock time spent
+      // inside the compressor counts. The output depends on timing, so it isn't deterministic.
+      lzham_uint32 m_target_kb_per_sec;
+
+      // Optional allocation policy (lzham_alloc_policy_flags) for the dictionary and match finder tables. Buffers the OS
+      // can't provide this way are allocated through the memory callbacks as usual.
+      lzham_uint32 m_alloc_policy;
+      lzham_uint32 m_numa_node;
+
+      // Optional set of CPUs (OS processor numbers) the helper threads may run on, e.g. the cores of one socket. CPUs the OS
+      // doesn't know or won't allow are ignored. Linux and Windows only (on Windows, only the first 64 CPUs). Neither this
+      // nor LZHAM_COMP_FLAG_HELPERS_SHARE_CACHE applies to the threads of a shared m_pTask_pool.
+      lzham_uint32 m_num_helper_cpus;
+      const lzham_uint32 *m_pHelper_cpus;
    };
    LZHAM_DLL_EXPORT lzham_compress_state_ptr lzham_compress_init(const lzham_compress_params *pParams);
 
@@ -102,6 +189,31 @@ extern "C" {
       lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
       lzham_bool no_more_input_bytes_flag);
 
+   // Like lzham_compress(), with an explicit flush mode. A sync or full flush is performed once all of *pIn_buf_size has
+   // been consumed; keep calling with the same flush mode (and no new input) until LZHAM_COMP_STATUS_NEEDS_MORE_INPUT is
+   // returned, at which point all of the flushed data has been output. Repeated flushes without new input don't add
+   // anything to the stream. Flushed streams require a decompressor from DLL version 0x100B or later.
+   LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress2(
+      lzham_compress_state_ptr pState,
+      const lzham_uint8 *pIn_buf, size_t *pIn_buf_size,
+      lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
+      lzham_flush_t flush_type);
+
+   // Rewinds a compressor to the start of a new stream with the parameters it was created with, keeping its dictionary,
+   // match finder, model tables and helper threads. Much cheaper than lzham_compress_deinit() + lzham_compress_init().
+   LZHAM_DLL_EXPORT lzham_bool lzham_compress_reset(lzham_compress_state_ptr pState);
+
+   // Returns the largest compressed size lzham_compress_memory() can produce for src_len bytes of input (at any
+   // dictionary size and flags), so a destination buffer of this size never fails with LZHAM_COMP_STATUS_OUTPUT_BUF_TOO_SMALL.
+   // Returns 0 if the bound doesn't fit in a size_t.
+   LZHAM_DLL_EXPORT size_t lzham_compress_bound(size_t src_len);
+
+   // Returns an estimate of the peak heap memory a compressor created with these parameters allocates (through the
+   // memory callbacks, or from the OS under m_alloc_policy), or 0 if the parameters are invalid. Set LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS to size
+   // lzham_compress_memory() or lzham_compress_framed_memory() calls, whose helper threads each run their own
+   // compressor. The caller's output buffers and the helper thread stacks aren't included.
+   LZHAM_DLL_EXPORT lzham_uint64 lzham_compress_get_memory_requirements(const lzham_compress_params *pParams);
+
    // single call interface
 
    LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress_memory(
@@ -112,6 +224,35 @@ extern "C" {
       size_t src_len,
       lzham_uint32 *pAdler32);
 
+   // Same as lzham_compress_memory(), but reuses a compressor created by lzham_compress_init() (it's reset first), so
+   // compressing many small buffers doesn't pay for allocating and clearing a new context each time.
+   LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress_memory_with_state(
+      lzham_compress_state_ptr pState,
+      lzham_uint8* pDst_buf,
+      size_t *pDst_len,
+      const lzham_uint8* pSrc_buf,
+      size_t src_len,
+      lzham_uint32 *pAdler32);
+
+   // Seekable framed container (single call interface)
+   // The source is split into frames of frame_size bytes (0=LZHAM_DEFAULT_FRAME_SIZE), each of which is compressed into a
+   // complete, independently decodable stream (frames are compressed in parallel when helper threads are enabled).
+   // The frames are followed by an index with one entry per frame, then a footer (all fields little endian):
+   //   index entry: uncompressed offset (8 bytes), compressed offset of the frame's stream (8), adler32 of the frame's data (4)
+   //   footer: total uncompressed size (8), number of frames (4), frame size (4), magic "LZHF" (4)
+   // Use lzham_decompress_range() to decode any byte range without decoding the frames before it.
+   // Smaller frames mean faster random access but a lower ratio, because matches never cross a frame boundary.
+   #define LZHAM_DEFAULT_FRAME_SIZE (4U*1024U*1024U)
+
+   LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress_framed_memory(
+      const lzham_compress_params *pParams,
+      lzham_uint32 frame_size,
+      lzham_uint8* pDst_buf,
+      size_t *pDst_len,
+      const lzham_uint8* pSrc_buf,
+      size_t src_len,
+      lzham_uint32 *pAdler32);
+
    // Decompression
    enum lzham_decompress_status_t
    {
@@ -141,6 +282,16 @@ extern "C" {
       lzham_uint32 m_dict_size_log2;
       lzham_bool m_output_unbuffered;
       lzham_bool m_compute_adler32;
+
+      // Preset dictionary, which must match the one used during compression (see lzham_compress_params). Streams using
+      // one are always decoded through the internal dictionary buffer, so m_output_unbuffered is ignored. The buffer must
+      // remain valid until the decompressor is deinitialized.
+      lzham_uint32 m_num_seed_bytes;
+      const void *m_pSeed_bytes;
+
+      // Optional allocation policy (lzham_alloc_policy_flags) for the dictionary buffer, which isn't needed when unbuffered.
+      lzham_uint32 m_alloc_policy;
+      lzham_uint32 m_numa_node;
    };
    LZHAM_DLL_EXPORT lzham_decompress_state_ptr lzham_decompress_init(const lzham_decompress_params *pParams);
 
@@ -153,6 +304,12 @@ extern "C" {
       lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
       lzham_bool no_more_input_bytes_flag);
 
+   // Rewinds a decompressor to the start of a new stream, keeping its dictionary buffer and model tables.
+   LZHAM_DLL_EXPORT lzham_bool lzham_decompress_reset(lzham_decompress_state_ptr pState);
+
+   // Returns the heap memory a decompressor created with these parameters allocates, or 0 if the parameters are invalid.
+   LZHAM_DLL_EXPORT lzham_uint64 lzham_decompress_get_memory_requirements(const lzham_decompress_params *pParams);
+
    // single call interface
    LZHAM_DLL_EXPORT lzham_decompress_status_t lzham_decompress_memory(
       const lzham_decompress_params *pParams,
@@ -162,17 +319,51 @@ extern "C" {
       size_t src_len,
       lzham_uint32 *pAdler32);
 
+   // Same as lzham_decompress_memory(), but reuses a decompressor created by lzham_decompress_init() (it's reset first).
+   // The state may have been created with or without m_output_unbuffered.
+   LZHAM_DLL_EXPORT lzham_decompress_status_t lzham_decompress_memory_with_state(
+      lzham_decompress_state_ptr pState,
+      lzham_uint8* pDst_buf,
+      size_t *pDst_len,
+      const lzham_uint8* pSrc_buf,
+      size_t src_len,
+      lzham_uint32 *pAdler32);
+
+   // Random access into a container written by lzham_compress_framed_memory(): decodes up to *pDst_len bytes starting at
+   // uncompressed offset range_ofs, touching only the frames that overlap the range. On return *pDst_len is the number of
+   // bytes written, which is less than requested only if the range extends past the end of the data.
+   // pParams->m_dict_size_log2 must match the value used during compression.
+   LZHAM_DLL_EXPORT lzham_decompress_status_t lzham_decompress_range(
+      const lzham_decompress_params *pParams,
+      lzham_uint8* pDst_buf,
+      size_t *pDst_len,
+      const lzham_uint8* pSrc_buf,
+      size_t src_len,
+      lzham_uint64 range_ofs);
+
    // Exported function typedefs, to simplify loading the LZHAM DLL dynamically.
    typedef lzham_uint32 (*lzham_get_version_func)(void);
    typedef void (*lzham_set_memory_callbacks_func)(lzham_realloc_func pRealloc, lzham_msize_func pMSize, void* pUser_data);
+   typedef lzham_task_pool_ptr (*lzham_create_task_pool_func)(lzham_uint32 num_threads);
+   typedef void (*lzham_destroy_task_pool_func)(lzham_task_pool_ptr pPool);
    typedef lzham_compress_state_ptr (*lzham_compress_init_func)(const lzham_compress_params *pParams);
    typedef lzham_uint32 (*lzham_compress_deinit_func)(lzham_compress_state_ptr pState);
    typedef lzham_compress_status_t (*lzham_compress_func)(lzham_compress_state_ptr pState, const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, lzham_uint8 *pOut_buf, size_t *pOut_buf_size, lzham_bool no_more_input_bytes_flag);
+   typedef lzham_compress_status_t (*lzham_compress2_func)(lzham_compress_state_ptr pState, const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, lzham_uint8 *pOut_buf, size_t *pOut_buf_size, lzham_flush_t flush_type);
+   typedef lzham_bool (*lzham_compress_reset_func)(lzham_compress_state_ptr pState);
+   typedef size_t (*lzham_compress_bound_func)(size_t src_len);
+   typedef lzham_uint64 (*lzham_compress_get_memory_requirements_func)(const lzham_compress_params *pParams);
    typedef lzham_compress_status_t (*lzham_compress_memory_func)(const lzham_compress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
+   typedef lzham_compress_status_t (*lzham_compress_memory_with_state_func)(lzham_compress_state_ptr pState, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
+   typedef lzham_compress_status_t (*lzham_compress_framed_memory_func)(const lzham_compress_params *pParams, lzham_uint32 frame_size, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
    typedef lzham_decompress_state_ptr (*lzham_decompress_init_func)(const lzham_decompress_params *pParams);
    typedef lzham_uint32 (*lzham_decompress_deinit_func)(lzham_decompress_state_ptr pState);
    typedef lzham_decompress_status_t (*lzham_decompress_func)(lzham_decompress_state_ptr pState, const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, lzham_uint8 *pOut_buf, size_t *pOut_buf_size, lzham_bool no_more_input_bytes_flag);
+   typedef lzham_bool (*lzham_decompress_reset_func)(lzham_decompress_state_ptr pState);
+   typedef lzham_uint64 (*lzham_decompress_get_memory_requirements_func)(const lzham_decompress_params *pParams);
    typedef lzham_decompress_status_t (*lzham_decompress_memory_func)(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
+   typedef lzham_decompress_status_t (*lzham_decompress_memory_with_state_func)(lzham_decompress_state_ptr pState, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
+   typedef lzham_decompress_status_t (*lzham_decompress_range_func)(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint64 range_ofs);
 
 #ifdef __cplusplus
 }
@@ -196,26 +387,50 @@ public:
    {
       lzham_get_version = NULL;
       lzham_set_memory_callbacks = NULL;
+      lzham_create_task_pool = NULL;
+      lzham_destroy_task_pool = NULL;
       lzham_compress_init = NULL;
       lzham_compress_deinit = NULL;
       lzham_compress = NULL;
+      lzham_compress2 = NULL;
+      lzham_compress_reset = NULL;
+      lzham_compress_bound = NULL;
+      lzham_compress_get_memory_requirements = NULL;
       lzham_compress_memory = NULL;
+      lzham_compress_memory_with_state = NULL;
+      lzham_compress_framed_memory = NULL;
       lzham_decompress_init = NULL;
       lzham_decompress_deinit = NULL;
       lzham_decompress = NULL;
+      lzham_decompress_reset = NULL;
+      lzham_decompress_get_memory_requirements = NULL;
       lzham_decompress_memory = NULL;
+      lzham_decompress_memory_with_state = NULL;
+      lzham_decompress_range = NULL;
    }
 
    lzham_get_version_func           lzham_get_version;
    lzham_set_memory_callbacks_func  lzham_set_memory_callbacks;
+   lzham_create_task_pool_func      lzham_create_task_pool;
+   lzham_destroy_task_pool_func     lzham_destroy_task_pool;
    lzham_compress_init_func         lzham_compress_init;
    lzham_compress_deinit_func       lzham_compress_deinit;
    lzham_compress_func              lzham_compress;
+   lzham_compress2_func             lzham_compress2;
+   lzham_compress_reset_func        lzham_compress_reset;
+   lzham_compress_bound_func        lzham_compress_bound;
+   lzham_compress_get_memory_requirements_func lzham_compress_get_memory_requirements;
    lzham_compress_memory_func       lzham_compress_memory;
+   lzham_compress_memory_with_state_func lzham_compress_memory_with_state;
+   lzham_compress_framed_memory_func lzham_compress_framed_memory;
    lzham_decompress_init_func       lzham_decompress_init;
    lzham_decompress_deinit_func     lzham_decompress_deinit;
    lzham_decompress_func            lzham_decompress;
+   lzham_decompress_reset_func      lzham_decompress_reset;
+   lzham_decompress_get_memory_requirements_func lzham_decompress_get_memory_requirements;
    lzham_decompress_memory_func     lzham_decompress_memory;
+   lzham_decompress_memory_with_state_func lzham_decompress_memory_with_state;
+   lzham_decompress_range_func      lzham_decompress_range;
 };
 #endif
 
@@ -5,6 +5,10 @@
 
 namespace lzham
 {
+   lzham_task_pool_ptr lzham_lib_create_task_pool(lzham_uint32 num_threads);
+
+   void lzham_lib_destroy_task_pool(lzham_task_pool_ptr pPool);
+
    lzham_compress_state_ptr lzham_lib_compress_init(const lzham_compress_params *pParams);
    
    lzham_uint32 lzham_lib_compress_deinit(lzham_compress_state_ptr p);
@@ -14,7 +18,23 @@ namespace lzham
       const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, 
       lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
       lzham_bool no_more_input_bytes_flag);
+
+   lzham_compress_status_t lzham_lib_compress2(
+      lzham_compress_state_ptr p,
+      const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, 
+      lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
+      lzham_flush_t flush_type);
    
+   lzham_bool lzham_lib_compress_reset(lzham_compress_state_ptr p);
+
+   size_t lzham_lib_compress_bound(size_t src_len);
+
+   lzham_uint64 lzham_lib_compress_get_memory_requirements(const lzham_compress_params *pParams);
+
    lzham_compress_status_t lzham_lib_compress_memory(const lzham_compress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
 
+   lzham_compress_status_t lzham_lib_compress_memory_with_state(lzham_compress_state_ptr p, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
+
+   lzham_compress_status_t lzham_lib_compress_framed_memory(const lzham_compress_params *pParams, lzham_uint32 frame_size, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
+
 } // namespace lzham
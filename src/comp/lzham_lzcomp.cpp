@@ -3,6 +3,7 @@
 #include "lzham_core.h"
 #include "lzham.h"
 #include "lzham_lzcomp_internal.h"
+#include "lzham_checksum.h"
 
 using namespace lzham;
 
@@ -13,6 +14,9 @@ namespace lzham
       // task_pool requires 8 or 16 alignment
       task_pool m_tp;
       lzcompressor m_compressor;
+
+      // Either &m_tp, the shared pool from lzham_compress_params, or NULL.
+      task_pool *m_pTask_pool;
             
       uint m_dict_size_log2;
 
@@ -45,9 +49,34 @@ namespace lzham
          
       params.m_dict_size_log2 = pParams->m_dict_size_log2;
       params.m_max_helper_threads = LZHAM_MIN(LZHAM_MAX_HELPER_THREADS, pParams->m_max_helper_threads);
+      if (pParams->m_pTask_pool)
+      {
+         task_pool *pShared_pool = static_cast<task_pool *>(pParams->m_pTask_pool);
+         const uint num_pool_threads = pShared_pool->get_num_threads();
+
+         params.m_pTask_pool = num_pool_threads ? pShared_pool : NULL;
+         params.m_max_helper_threads = params.m_max_helper_threads ? LZHAM_MIN(params.m_max_helper_threads, num_pool_threads) : LZHAM_MIN(LZHAM_MAX_HELPER_THREADS, num_pool_threads);
+      }
       params.m_num_cachelines = pParams->m_cpucache_total_lines;
       params.m_cacheline_size = pParams->m_cpucache_line_size;
       params.m_lzham_compress_flags = pParams->m_compress_flags;
+
+      if ((pParams->m_num_seed_bytes) && (!pParams->m_pSeed_bytes))
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      params.m_num_seed_bytes = pParams->m_num_seed_bytes;
+      params.m_pSeed_bytes = static_cast<const uint8 *>(pParams->m_pSeed_bytes);
+
+      params.m_target_kb_per_sec = pParams->m_target_kb_per_sec;
+
+      params.m_alloc_policy = pParams->m_alloc_policy;
+      params.m_numa_node = pParams->m_numa_node;
+
+      if ((pParams->m_num_helper_cpus) && (!pParams->m_pHelper_cpus))
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      params.m_num_helper_cpus = pParams->m_num_helper_cpus;
+      params.m_pHelper_cpus = pParams->m_pHelper_cpus;
       
       switch (pParams->m_level)
       {
@@ -63,6 +92,66 @@ namespace lzham
       return LZHAM_COMP_STATUS_SUCCESS;
    }
    
+   // Starts the helper threads of a compressor's own pool, on the CPUs the params ask for.
+   static bool init_task_pool(task_pool &tp, const lzcompressor::init_params &params)
+   {
+      const uint cMaxCacheSharingCPUs = 1024;
+      uint cache_sharing_cpus[cMaxCacheSharingCPUs];
+
+      const uint *pCPUs = params.m_pHelper_cpus;
+      uint num_cpus = params.m_num_helper_cpus;
+      if ((!num_cpus) && (params.m_lzham_compress_flags & LZHAM_COMP_FLAG_HELPERS_SHARE_CACHE))
+      {
+         num_cpus = lzham_get_cache_sharing_cpus(cache_sharing_cpus, cMaxCacheSharingCPUs);
+         pCPUs = cache_sharing_cpus;
+      }
+
+      return tp.init(params.m_max_helper_threads, pCPUs, num_cpus);
+   }
+
+   // Creates a pool for a single call, unless create_init_params() already picked up a shared one.
+   static bool create_call_task_pool(lzcompressor::init_params &params, task_pool *&pCall_pool)
+   {
+      pCall_pool = NULL;
+      if ((params.m_pTask_pool) || (!params.m_max_helper_threads))
+         return true;
+
+      pCall_pool = lzham_new<task_pool>();
+      if ((!pCall_pool) || (!init_task_pool(*pCall_pool, params)))
+      {
+         lzham_delete(pCall_pool);
+         pCall_pool = NULL;
+         return false;
+      }
+
+      params.m_pTask_pool = pCall_pool;
+      return true;
+   }
+
+   lzham_task_pool_ptr lzham_lib_create_task_pool(lzham_uint32 num_threads)
+   {
+      if ((!num_threads) || (num_threads > LZHAM_MAX_HELPER_THREADS))
+         return NULL;
+
+      task_pool *pPool = lzham_new<task_pool>();
+      if (!pPool)
+         return NULL;
+
+      if (!pPool->init(num_threads))
+      {
+         lzham_delete(pPool);
+         return NULL;
+      }
+
+      return pPool;
+   }
+
+   void lzham_lib_destroy_task_pool(lzham_task_pool_ptr p)
+   {
+      task_pool *pPool = static_cast<task_pool *>(p);
+      lzham_delete(pPool);
+   }
+
    lzham_compress_state_ptr lzham_lib_compress_init(const lzham_compress_params *pParams)
    {
       if ((!pParams) || (pParams->m_struct_size != sizeof(lzham_compress_params)))   
@@ -89,10 +178,11 @@ namespace lzham
       pState->m_status = LZHAM_COMP_STATUS_NOT_FINISHED;
       pState->m_comp_data_ofs = 0;
       pState->m_flushed_compressor = false;
+      pState->m_pTask_pool = params.m_pTask_pool;
       
-      if (params.m_max_helper_threads)
+      if ((params.m_max_helper_threads) && (!params.m_pTask_pool))
       {
-         if (!pState->m_tp.init(params.m_max_helper_threads))
+         if (!init_task_pool(pState->m_tp, params))
          {
             lzham_delete(pState);
             return NULL;
@@ -100,6 +190,7 @@ namespace lzham
          if (pState->m_tp.get_num_threads() >= params.m_max_helper_threads)
          {
             params.m_pTask_pool = &pState->m_tp;
+            pState->m_pTask_pool = &pState->m_tp;
          }
          else
          {
@@ -129,11 +220,11 @@ namespace lzham
       return adler32;
    }
 
-   lzham_compress_status_t lzham_lib_compress(
+   lzham_compress_status_t lzham_lib_compress2(
       lzham_compress_state_ptr p,
       const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, 
       lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
-      lzham_bool no_more_input_bytes_flag)
+      lzham_flush_t flush_type)
    {
       lzham_compress_state *pState = static_cast<lzham_compress_state*>(p);
 
@@ -141,6 +232,13 @@ namespace lzham
       {
          return LZHAM_COMP_STATUS_INVALID_PARAMETER;
       }
+
+      if (static_cast<uint>(flush_type) > LZHAM_FLUSH_FINISH)
+      {
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+      }
+
+      const bool no_more_input_bytes_flag = (flush_type == LZHAM_FLUSH_FINISH);
       
       if ((*pIn_buf_size) && (!pIn_buf))
       {
@@ -188,10 +286,15 @@ namespace lzham
       size_t bytes_to_put = LZHAM_MIN(cMaxBytesToPutPerIteration, *pIn_buf_size);
       const bool consumed_entire_input_buf = (bytes_to_put == *pIn_buf_size);
 
+      // Nothing is staged, so let the compressor write whatever it emits during this call directly into the caller's buffer.
+      pState->m_compressor.set_output_buf(pOut_buf, *pOut_buf_size);
+
       if (bytes_to_put)
       {
-         if (!pState->m_compressor.put_bytes(pIn_buf, (uint)bytes_to_put))
+         if (!pState->m_compressor.put_bytes(pIn_buf, bytes_to_put))
          {
+            pState->m_compressor.set_output_buf(NULL, 0);
+
             *pIn_buf_size = 0;
             *pOut_buf_size = 0;
             
@@ -204,6 +307,8 @@ namespace lzham
       {
          if (!pState->m_compressor.put_bytes(NULL, 0))
          {
+            pState->m_compressor.set_output_buf(NULL, 0);
+
             *pIn_buf_size = 0;
             *pOut_buf_size = 0;
 
@@ -212,16 +317,34 @@ namespace lzham
          }  
          pState->m_flushed_compressor = true;  
       }
+      else if ((consumed_entire_input_buf) && ((flush_type == LZHAM_FLUSH_SYNC) || (flush_type == LZHAM_FLUSH_FULL)))
+      {
+         if (!pState->m_compressor.flush(flush_type == LZHAM_FLUSH_FULL))
+         {
+            pState->m_compressor.set_output_buf(NULL, 0);
+
+            *pIn_buf_size = 0;
+            *pOut_buf_size = 0;
+
+            pState->m_status = LZHAM_COMP_STATUS_FAILED;
+            return pState->m_status;
+         }
+      }
+
+      const size_t direct_bytes = pState->m_compressor.get_output_buf_ofs();
+      pState->m_compressor.set_output_buf(NULL, 0);
                   
       *pIn_buf_size = bytes_to_put;
       
-      *pOut_buf_size = LZHAM_MIN(comp_data.size() - pState->m_comp_data_ofs, *pOut_buf_size);   
-      if (*pOut_buf_size)
+      size_t staged_bytes = LZHAM_MIN(comp_data.size() - pState->m_comp_data_ofs, *pOut_buf_size - direct_bytes);   
+      if (staged_bytes)
       {
-         memcpy(pOut_buf, comp_data.get_ptr() + pState->m_comp_data_ofs, *pOut_buf_size);
+         memcpy(pOut_buf + direct_bytes, comp_data.get_ptr() + pState->m_comp_data_ofs, staged_bytes);
 
-         pState->m_comp_data_ofs += *pOut_buf_size;
+         pState->m_comp_data_ofs += staged_bytes;
       }
+
+      *pOut_buf_size = direct_bytes + staged_bytes;
       
       if ((no_more_input_bytes_flag) && (pState->m_flushed_compressor) && (pState->m_comp_data_ofs >= comp_data.size()))
          pState->m_status = LZHAM_COMP_STATUS_SUCCESS;
@@ -233,36 +356,303 @@ namespace lzham
       return pState->m_status;  
    }      
 
-   lzham_compress_status_t lzham_lib_compress_memory(const lzham_compress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+   lzham_compress_status_t lzham_lib_compress(
+      lzham_compress_state_ptr p,
+      const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, 
+      lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
+      lzham_bool no_more_input_bytes_flag)
    {
-      if ((!pParams) || (!pDst_len))
-         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+      return lzham_lib_compress2(p, pIn_buf, pIn_buf_size, pOut_buf, pOut_buf_size, no_more_input_bytes_flag ? LZHAM_FLUSH_FINISH : LZHAM_FLUSH_NONE);
+   }
+
+   // Compresses a source buffer as a series of independent chunks, in parallel, using a separate lzcompressor per worker
+   // (each with its own dictionary and models). Used by the independent chunk mode (LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS),
+   // where the chunks are joined into a single stream separated by reset blocks, and by the seekable framed container,
+   // where every chunk is a complete stream.
+   class independent_chunk_compressor
+   {
+   public:
+      enum { cMinChunkSize = 4U*1024U*1024U };
+
+      independent_chunk_compressor() :
+         m_pSrc_buf(NULL),
+         m_src_len(0),
+         m_chunk_size(0),
+         m_num_chunks(0),
+         m_complete_streams(false),
+         m_next_chunk_index(0),
+         m_failed(0)
+      {
+      }
+
+      void init(const lzcompressor::init_params &params, const uint8 *pSrc_buf, size_t src_len, uint chunk_size, bool complete_streams)
+      {
+         LZHAM_ASSERT(chunk_size);
+
+         m_params = params;
+         m_params.m_pTask_pool = NULL;
+         m_params.m_max_helper_threads = 0;
+
+         m_pSrc_buf = pSrc_buf;
+         m_src_len = src_len;
+         m_chunk_size = chunk_size;
+         m_num_chunks = static_cast<uint>((src_len + m_chunk_size - 1) / m_chunk_size);
+         m_complete_streams = complete_streams;
+         m_next_chunk_index = 0;
+         m_failed = 0;
+      }
+
+      static uint get_default_chunk_size(const lzcompressor::init_params &params)
+      {
+         return LZHAM_MAX(1U << params.m_dict_size_log2, static_cast<uint>(cMinChunkSize));
+      }
+
+      bool compress(task_pool *pTP, uint max_helper_threads)
+      {
+         if ((!m_comp_data.try_resize(m_num_chunks)) || (!m_adler32.try_resize(m_num_chunks)))
+            return false;
+
+         uint num_workers = 1;
+         if ((pTP) && (pTP->get_num_threads()))
+            num_workers = LZHAM_MIN(m_num_chunks, max_helper_threads + 1);
+
+         // The workers share the throughput target.
+         if (m_params.m_target_kb_per_sec)
+            m_params.m_target_kb_per_sec = LZHAM_MAX(1U, m_params.m_target_kb_per_sec / num_workers);
+
+         if (num_workers > 1)
+         {
+            if (!pTP->queue_multiple_object_tasks(this, &independent_chunk_compressor::worker_callback, 1, num_workers - 1, NULL, &m_task_group))
+               m_failed = true;
+         }
+
+         worker_callback(0, NULL);
+
+         if (num_workers > 1)
+            pTP->join(&m_task_group);
+
+         return !m_failed;
+      }
+
+      uint get_num_chunks() const { return m_num_chunks; }
+      const byte_vec& get_chunk_comp_data(uint chunk_index) const { return m_comp_data[chunk_index]; }
+      uint32 get_chunk_adler32(uint chunk_index) const { return m_adler32[chunk_index]; }
+
+      size_t get_total_comp_size() const
+      {
+         size_t total = 0;
+         for (uint i = 0; i < m_num_chunks; i++)
+            total += m_comp_data[i].size();
+         return total;
+      }
+
+      uint32 get_src_adler32() const
+      {
+         uint32 adler = cInitAdler32;
+         for (uint i = 0; i < m_num_chunks; i++)
+            adler = adler32_combine(adler, m_adler32[i], get_chunk_size(i));
+         return adler;
+      }
+
+      void copy_comp_data(uint8 *pDst) const
+      {
+         for (uint i = 0; i < m_num_chunks; i++)
+         {
+            memcpy(pDst, m_comp_data[i].get_ptr(), m_comp_data[i].size());
+            pDst += m_comp_data[i].size();
+         }
+      }
+
+   private:
+      lzcompressor::init_params m_params;
+      const uint8 *m_pSrc_buf;
+      size_t m_src_len;
+      uint m_chunk_size;
+      uint m_num_chunks;
+      bool m_complete_streams;
+
+      lzham::vector<byte_vec> m_comp_data;
+      lzham::vector<uint32> m_adler32;
+
+      volatile atomic32_t m_next_chunk_index;
+      volatile atomic32_t m_failed;
+
+      task_pool::task_group m_task_group;
+
+      uint get_chunk_size(uint chunk_index) const
+      {
+         return static_cast<uint>(LZHAM_MIN(static_cast<size_t>(m_chunk_size), m_src_len - static_cast<size_t>(chunk_index) * m_chunk_size));
+      }
+
+      void worker_callback(uint64 data, void* pData_ptr)
+      {
+         data, pData_ptr;
+
+         lzcompressor *pCompressor = lzham_new<lzcompressor>();
+         if (!pCompressor)
+         {
+            m_failed = true;
+            return;
+         }
+
+         // Chunks are claimed in order, so a slow chunk never holds up the ones after it.
+         for ( ; ; )
+         {
+            const uint chunk_index = static_cast<uint>(atomic_increment32(&m_next_chunk_index) - 1);
+            if ((chunk_index >= m_num_chunks) || (m_failed))
+               break;
+
+            lzcompressor::init_params params(m_params);
+            params.m_reset_models_at_start = (!m_complete_streams) && (chunk_index > 0);
+
+            // In a single stream the decompressor's window holds the previous chunk, not the preset dictionary, by the
+            // time it reaches a later chunk. Complete streams (frames) are each decoded with the dictionary.
+            if (params.m_reset_models_at_start)
+            {
+               params.m_num_seed_bytes = 0;
+               params.m_pSeed_bytes = NULL;
+            }
+            params.m_omit_final_block = !m_complete_streams;
+
+            if ( (!pCompressor->init(params)) ||
+                 (!pCompressor->put_bytes(m_pSrc_buf + static_cast<size_t>(chunk_index) * m_chunk_size, get_chunk_size(chunk_index))) ||
+                 (!pCompressor->put_bytes(NULL, 0)) )
+            {
+               m_failed = true;
+               break;
+            }
+
+            m_comp_data[chunk_index].swap(pCompressor->get_compressed_data());
+            m_adler32[chunk_index] = pCompressor->get_src_adler32();
+         }
+
+         lzham_delete(pCompressor);
+      }
+   };
+
+   static lzham_compress_status_t compress_memory_independent_chunks(const lzcompressor::init_params &params, task_pool *pTP, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+   {
+      independent_chunk_compressor *pChunk_compressor = lzham_new<independent_chunk_compressor>();
+      if (!pChunk_compressor)
+         return LZHAM_COMP_STATUS_FAILED;
+
+      pChunk_compressor->init(params, pSrc_buf, src_len, independent_chunk_compressor::get_default_chunk_size(params), false);
+
+      bool status = pChunk_compressor->compress(pTP, params.m_max_helper_threads);
+
+      byte_vec final_block;
+      const uint32 src_adler32 = pChunk_compressor->get_src_adler32();
+      if ((!status) || (!lzcompressor::append_final_block(final_block, src_adler32)))
+      {
+         *pDst_len = 0;
+         lzham_delete(pChunk_compressor);
+         return LZHAM_COMP_STATUS_FAILED;
+      }
+
+      const size_t chunk_comp_size = pChunk_compressor->get_total_comp_size();
+
+      size_t dst_buf_size = *pDst_len;
+      *pDst_len = chunk_comp_size + final_block.size();
+
+      if (pAdler32)
+         *pAdler32 = src_adler32;
+
+      if (*pDst_len > dst_buf_size)
+      {
+         lzham_delete(pChunk_compressor);
+         return LZHAM_COMP_STATUS_OUTPUT_BUF_TOO_SMALL;
+      }
+
+      pChunk_compressor->copy_comp_data(pDst_buf);
+      memcpy(pDst_buf + chunk_comp_size, final_block.get_ptr(), final_block.size());
+
+      lzham_delete(pChunk_compressor);
+      return LZHAM_COMP_STATUS_SUCCESS;
+   }
+
+   // Compresses an entire buffer with a freshly initialized or reset compressor.
+   static lzham_compress_status_t compress_memory_internal(lzcompressor &compressor, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+   {
+      // Compressed blocks go straight into pDst_buf until it runs out of room.
+      size_t dst_buf_size = *pDst_len;
+      compressor.set_output_buf(pDst_buf, dst_buf_size);
 
       if (src_len)
       {
-         if (!pSrc_buf)
-            return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+         if (!compressor.put_bytes(pSrc_buf, src_len))
+         {
+            compressor.set_output_buf(NULL, 0);
+            *pDst_len = 0;
+            return LZHAM_COMP_STATUS_FAILED;
+         }
       }
 
-      if (sizeof(size_t) > sizeof(uint32))
+      if (!compressor.put_bytes(NULL, 0))
+      {
+         compressor.set_output_buf(NULL, 0);
+         *pDst_len = 0;
+         return LZHAM_COMP_STATUS_FAILED;
+      }
+
+      const size_t direct_bytes = compressor.get_output_buf_ofs();
+      compressor.set_output_buf(NULL, 0);
+
+      const byte_vec &comp_data = compressor.get_compressed_data();
+
+      *pDst_len = direct_bytes + comp_data.size();
+
+      if (pAdler32)
+         *pAdler32 = compressor.get_src_adler32();
+
+      if (*pDst_len > dst_buf_size)
+         return LZHAM_COMP_STATUS_OUTPUT_BUF_TOO_SMALL;
+
+      if (comp_data.size())
+         memcpy(pDst_buf + direct_bytes, comp_data.get_ptr(), comp_data.size());
+
+      return LZHAM_COMP_STATUS_SUCCESS;
+   }
+
+   static lzham_compress_status_t check_compress_memory_params(lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len)
+   {
+      if (!pDst_len)
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      if ((*pDst_len) && (!pDst_buf))
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      if (src_len)
       {
-         if (src_len > UINT32_MAX)
+         if (!pSrc_buf)
             return LZHAM_COMP_STATUS_INVALID_PARAMETER;
       }
 
+      return LZHAM_COMP_STATUS_SUCCESS;
+   }
+
+   lzham_compress_status_t lzham_lib_compress_memory(const lzham_compress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+   {
+      if (!pParams)
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      lzham_compress_status_t status = check_compress_memory_params(pDst_buf, pDst_len, pSrc_buf, src_len);
+      if (status != LZHAM_COMP_STATUS_SUCCESS)
+         return status;
+
       lzcompressor::init_params params;
-      lzham_compress_status_t status = create_init_params(params, pParams);
+      status = create_init_params(params, pParams);
       if (status != LZHAM_COMP_STATUS_SUCCESS)
          return status;
 
       task_pool *pTP = NULL;
-      if (params.m_max_helper_threads)
-      {
-         pTP = lzham_new<task_pool>();
-         if (!pTP->init(params.m_max_helper_threads))   
-            return LZHAM_COMP_STATUS_FAILED;
+      if (!create_call_task_pool(params, pTP))
+         return LZHAM_COMP_STATUS_FAILED;
 
-         params.m_pTask_pool = pTP;
+      if ((pParams->m_compress_flags & LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS) && (src_len > independent_chunk_compressor::get_default_chunk_size(params)))
+      {
+         status = compress_memory_independent_chunks(params, params.m_pTask_pool, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
+         lzham_delete(pTP);
+         return status;
       }
 
       lzcompressor *pCompressor = lzham_new<lzcompressor>();
@@ -279,45 +669,208 @@ namespace lzham
          return LZHAM_COMP_STATUS_INVALID_PARAMETER;
       }
 
-      if (src_len)
+      status = compress_memory_internal(*pCompressor, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
+
+      lzham_delete(pTP);
+      lzham_delete(pCompressor);
+      return status;  
+   }
+
+   size_t lzham_lib_compress_bound(size_t src_len)
+   {
+      // Blocks that don't compress are stored raw, so the worst case is every block stored raw, each with its header. Blocks
+      // are only smaller than the smallest dictionary's block size at the end of the input and of each independent chunk.
+      const uint cMaxBlockOverhead = 8;
+      const uint cMaxStreamOverhead = 16;
+      const size_t cMinBlockSize = (1U << CLZBase::cMinDictSizeLog2) / 8;
+
+      const size_t max_blocks = src_len / cMinBlockSize + src_len / independent_chunk_compressor::cMinChunkSize + 2;
+
+      const size_t bound = src_len + max_blocks * cMaxBlockOverhead + cMaxStreamOverhead;
+      return (bound < src_len) ? 0 : bound;
+   }
+
+   lzham_uint64 lzham_lib_compress_get_memory_requirements(const lzham_compress_params *pParams)
+   {
+      if ((!pParams) || (pParams->m_struct_size != sizeof(lzham_compress_params)))
+         return 0;
+
+      lzcompressor::init_params params;
+      if (create_init_params(params, pParams) != LZHAM_COMP_STATUS_SUCCESS)
+         return 0;
+
+      const uint64 compressor_total = lzcompressor::get_memory_requirements(params);
+      if (!compressor_total)
+         return 0;
+
+      uint64 total = sizeof(lzham_compress_state) + compressor_total;
+
+      if (pParams->m_compress_flags & LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS)
       {
-         if (!pCompressor->put_bytes(pSrc_buf, static_cast<uint32>(src_len)))
+         // Every worker (the helper threads plus the caller) has its own single threaded compressor.
+         lzcompressor::init_params worker_params(params);
+         worker_params.m_pTask_pool = NULL;
+         worker_params.m_max_helper_threads = 0;
+
+         const uint64 worker_total = sizeof(lzcompressor) + lzcompressor::get_memory_requirements(worker_params);
+         total = LZHAM_MAX(total, worker_total * (params.m_max_helper_threads + 1));
+      }
+
+      return total;
+   }
+
+   lzham_bool lzham_lib_compress_reset(lzham_compress_state_ptr p)
+   {
+      lzham_compress_state *pState = static_cast<lzham_compress_state*>(p);
+      if (!pState)
+         return false;
+
+      pState->m_pIn_buf = NULL;
+      pState->m_pIn_buf_size = NULL;
+      pState->m_pOut_buf = NULL;
+      pState->m_pOut_buf_size = NULL;
+      pState->m_comp_data_ofs = 0;
+      pState->m_flushed_compressor = false;
+
+      if (!pState->m_compressor.reset())
+      {
+         pState->m_status = LZHAM_COMP_STATUS_FAILED;
+         return false;
+      }
+
+      pState->m_status = LZHAM_COMP_STATUS_NOT_FINISHED;
+      return true;
+   }
+
+   lzham_compress_status_t lzham_lib_compress_memory_with_state(lzham_compress_state_ptr p, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+   {
+      lzham_compress_state *pState = static_cast<lzham_compress_state*>(p);
+      if (!pState)
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      lzham_compress_status_t status = check_compress_memory_params(pDst_buf, pDst_len, pSrc_buf, src_len);
+      if (status != LZHAM_COMP_STATUS_SUCCESS)
+         return status;
+
+      if (!lzham_lib_compress_reset(pState))
+         return LZHAM_COMP_STATUS_FAILED;
+
+      if (pState->m_params.m_compress_flags & LZHAM_COMP_FLAG_INDEPENDENT_CHUNKS)
+      {
+         lzcompressor::init_params params;
+         status = create_init_params(params, &pState->m_params);
+         if (status != LZHAM_COMP_STATUS_SUCCESS)
+            return status;
+
+         if (src_len > independent_chunk_compressor::get_default_chunk_size(params))
          {
-            *pDst_len = 0;
-            lzham_delete(pTP);
-            lzham_delete(pCompressor);
-            return LZHAM_COMP_STATUS_FAILED;
+            params.m_pTask_pool = pState->m_pTask_pool;
+            if (!params.m_pTask_pool)
+               params.m_max_helper_threads = 0;
+
+            status = compress_memory_independent_chunks(params, params.m_pTask_pool, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
+            pState->m_status = (status == LZHAM_COMP_STATUS_OUTPUT_BUF_TOO_SMALL) ? LZHAM_COMP_STATUS_FAILED : status;
+            return status;
          }
       }
 
-      if (!pCompressor->put_bytes(NULL, 0))
+      status = compress_memory_internal(pState->m_compressor, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
+
+      // The state is left finished; the next call (or lzham_compress_reset()) starts a new stream.
+      pState->m_flushed_compressor = true;
+      pState->m_comp_data_ofs = pState->m_compressor.get_compressed_data().size();
+      pState->m_status = (status == LZHAM_COMP_STATUS_OUTPUT_BUF_TOO_SMALL) ? LZHAM_COMP_STATUS_FAILED : status;
+      return status;
+   }
+
+   static inline uint8* write_le(uint8 *pDst, uint64 val, uint num_bytes)
+   {
+      for (uint i = 0; i < num_bytes; i++)
+         *pDst++ = static_cast<uint8>(val >> (i * 8));
+      return pDst;
+   }
+
+   lzham_compress_status_t lzham_lib_compress_framed_memory(const lzham_compress_params *pParams, lzham_uint32 frame_size, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+   {
+      if ((!pParams) || (!pDst_len))
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      if ((src_len) && (!pSrc_buf))
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      if (!frame_size)
+         frame_size = LZHAM_DEFAULT_FRAME_SIZE;
+
+      // The footer stores the number of frames in 32 bits, and the workers claim them with a 32-bit counter.
+      if (((static_cast<uint64>(src_len) + frame_size - 1) / frame_size) > static_cast<uint64>(INT32_MAX))
+         return LZHAM_COMP_STATUS_INVALID_PARAMETER;
+
+      lzcompressor::init_params params;
+      lzham_compress_status_t status = create_init_params(params, pParams);
+      if (status != LZHAM_COMP_STATUS_SUCCESS)
+         return status;
+
+      task_pool *pTP = NULL;
+      if (!create_call_task_pool(params, pTP))
+         return LZHAM_COMP_STATUS_FAILED;
+
+      independent_chunk_compressor *pChunk_compressor = lzham_new<independent_chunk_compressor>();
+      if (!pChunk_compressor)
       {
-         *pDst_len = 0;
          lzham_delete(pTP);
-         lzham_delete(pCompressor);
          return LZHAM_COMP_STATUS_FAILED;
       }
 
-      const byte_vec &comp_data = pCompressor->get_compressed_data();
+      pChunk_compressor->init(params, pSrc_buf, src_len, frame_size, true);
+
+      bool succeeded = pChunk_compressor->compress(params.m_pTask_pool, params.m_max_helper_threads);
+
+      lzham_delete(pTP);
+
+      if (!succeeded)
+      {
+         *pDst_len = 0;
+         lzham_delete(pChunk_compressor);
+         return LZHAM_COMP_STATUS_FAILED;
+      }
+
+      const uint num_frames = pChunk_compressor->get_num_chunks();
+      const size_t frames_size = pChunk_compressor->get_total_comp_size();
 
       size_t dst_buf_size = *pDst_len;
-      *pDst_len = comp_data.size();
+      *pDst_len = frames_size + num_frames * CLZDecompBase::cFrameIndexEntrySize + CLZDecompBase::cFrameFooterSize;
 
       if (pAdler32)
-         *pAdler32 = pCompressor->get_src_adler32();
+         *pAdler32 = pChunk_compressor->get_src_adler32();
 
-      if (comp_data.size() > dst_buf_size)
+      if (*pDst_len > dst_buf_size)
       {
-         lzham_delete(pTP);
-         lzham_delete(pCompressor);
+         lzham_delete(pChunk_compressor);
          return LZHAM_COMP_STATUS_OUTPUT_BUF_TOO_SMALL;
       }
 
-      memcpy(pDst_buf, comp_data.get_ptr(), comp_data.size());
+      pChunk_compressor->copy_comp_data(pDst_buf);
 
-      lzham_delete(pTP);
-      lzham_delete(pCompressor);
-      return LZHAM_COMP_STATUS_SUCCESS;  
+      uint8 *pIndex = pDst_buf + frames_size;
+      uint64 comp_ofs = 0;
+      for (uint i = 0; i < num_frames; i++)
+      {
+         pIndex = write_le(pIndex, static_cast<uint64>(i) * frame_size, 8);
+         pIndex = write_le(pIndex, comp_ofs, 8);
+         pIndex = write_le(pIndex, pChunk_compressor->get_chunk_adler32(i), 4);
+
+         comp_ofs += pChunk_compressor->get_chunk_comp_data(i).size();
+      }
+
+      pIndex = write_le(pIndex, src_len, 8);
+      pIndex = write_le(pIndex, num_frames, 4);
+      pIndex = write_le(pIndex, frame_size, 4);
+      pIndex = write_le(pIndex, CLZDecompBase::cFrameFooterMagic, 4);
+
+      LZHAM_ASSERT(pIndex == (pDst_buf + *pDst_len));
+
+      lzham_delete(pChunk_compressor);
+      return LZHAM_COMP_STATUS_SUCCESS;
    }
 
 } // namespace lzham
@@ -28,6 +28,8 @@ namespace lzham
          true,                            // m_use_polar_codes
          1,                               // m_match_accel_max_matches_per_probe
          2,                               // m_match_accel_max_probes
+         search_accelerator::cMatchFinderHashChain,   // m_match_finder
+         20,                              // m_match_accel_hash_chain_bits
       },
       // cCompressionLevelFaster
       {
@@ -36,6 +38,8 @@ namespace lzham
          true,                            // m_use_polar_codes
          6,                               // m_match_accel_max_matches_per_probe
          12,                              // m_match_accel_max_probes
+         search_accelerator::cMatchFinderBinaryTree,   // m_match_finder
+         0,                               // m_match_accel_hash_chain_bits
       },
       // cCompressionLevelDefault
       {
@@ -44,6 +48,8 @@ namespace lzham
          true,                            // m_use_polar_codes
          UINT_MAX,                        // m_match_accel_max_matches_per_probe
          16,                              // m_match_accel_max_probes
+         search_accelerator::cMatchFinderBinaryTree,   // m_match_finder
+         0,                               // m_match_accel_hash_chain_bits
       },
       // cCompressionLevelBetter
       {
@@ -52,6 +58,8 @@ namespace lzham
          false,                           // m_use_polar_codes
          UINT_MAX,                        // m_match_accel_max_matches_per_probe
          32,                              // m_match_accel_max_probes
+         search_accelerator::cMatchFinderBinaryTree,   // m_match_finder
+         0,                               // m_match_accel_hash_chain_bits
       },
       // cCompressionLevelUber
       {
@@ -60,6 +68,8 @@ namespace lzham
          false,                           // m_use_polar_codes
          UINT_MAX,                        // m_match_accel_max_matches_per_probe
          cMatchAccelMaxSupportedProbes,   // m_match_accel_max_probes
+         search_accelerator::cMatchFinderBinaryTree,   // m_match_finder
+         0,                               // m_match_accel_hash_chain_bits
       }
    };
 
@@ -102,12 +112,63 @@ namespace lzham
       for (uint i = 0; i < (1 << CLZBase::cNumDeltaLitPredBits); i++)
          m_delta_lit_table[i].clear();
 
+      reset_bit_models();
+
       m_match_hist[0] = 1;
       m_match_hist[1] = 1;
       m_match_hist[2] = 1;
       m_match_hist[3] = 1;
    }
 
+   void lzcompressor::state::reset_bit_models()
+   {
+      for (uint i = 0; i < LZHAM_ARRAY_SIZE(m_is_match_model); i++)
+         m_is_match_model[i].clear();
+
+      for (uint i = 0; i < CLZBase::cNumStates; i++)
+      {
+         m_is_rep_model[i].clear();
+         m_is_rep0_model[i].clear();
+         m_is_rep0_single_byte_model[i].clear();
+         m_is_rep1_model[i].clear();
+         m_is_rep2_model[i].clear();
+      }
+   }
+
+   bool lzcompressor::state::reset()
+   {
+      m_cur_ofs = 0;
+      m_cur_state = 0;
+      m_block_start_dict_ofs = 0;
+
+      for (uint i = 0; i < 2; i++)
+      {
+         if (!m_rep_len_table[i].reset()) return false;
+         if (!m_large_len_table[i].reset()) return false;
+      }
+      if (!m_main_table.reset()) return false;
+      if (!m_dist_lsb_table.reset()) return false;
+
+      for (uint i = 0; i < (1 << CLZBase::cNumLitPredBits); i++)
+      {
+         if (!m_lit_table[i].reset()) return false;
+      }
+
+      for (uint i = 0; i < (1 << CLZBase::cNumDeltaLitPredBits); i++)
+      {
+         if (!m_delta_lit_table[i].reset()) return false;
+      }
+
+      reset_bit_models();
+
+      m_match_hist[0] = 1;
+      m_match_hist[1] = 1;
+      m_match_hist[2] = 1;
+      m_match_hist[3] = 1;
+
+      return true;
+   }
+
    bool lzcompressor::state::init(CLZBase& lzbase, bool fast_adaptive_huffman_updating, bool use_polar_codes)
    {
       m_cur_ofs = 0;
@@ -392,7 +453,7 @@ namespace lzham
       return cost;
    }
 
-   bit_cost_t lzcompressor::state::get_lit_cost(const search_accelerator& dict, uint dict_pos, uint lit_pred0, uint is_match_model_index) const
+   bit_cost_t lzcompressor::state::get_lit_cost(const search_accelerator& dict, uint dict_pos, uint lit_pred0, uint is_match_model_index, const lit_price_tables& lit_prices) const
    {
       bit_cost_t cost = m_is_match_model[is_match_model_index].get_cost(0);
 
@@ -406,7 +467,7 @@ namespace lzham
          uint lit_pred = (lit_pred0 >> (8 - CLZBase::cNumLitPredBits/2)) |
             (((lit_pred1 >> (8 - CLZBase::cNumLitPredBits/2)) << CLZBase::cNumLitPredBits/2));
 
-         cost += m_lit_table[lit_pred].get_cost(lit);
+         cost += lit_prices.m_lit[lit_pred][lit] << cBitCostScaleShift;
       }
       else
       {
@@ -419,7 +480,7 @@ namespace lzham
          uint lit_pred = (rep_lit0 >> (8 - CLZBase::cNumDeltaLitPredBits/2)) |
             ((rep_lit1 >> (8 - CLZBase::cNumDeltaLitPredBits/2)) << CLZBase::cNumDeltaLitPredBits/2);
 
-         cost += m_delta_lit_table[lit_pred].get_cost(delta_lit);
+         cost += lit_prices.m_delta_lit[lit_pred][delta_lit] << cBitCostScaleShift;
       }
 
       return cost;
@@ -919,6 +980,57 @@ namespace lzham
       m_block_start_dict_ofs = cur_ofs;
    }
 
+   static inline void copy_code_sizes(quasi_adaptive_huffman_data_model& dst, const quasi_adaptive_huffman_data_model& src)
+   {
+      LZHAM_ASSERT(dst.m_code_sizes.size() == src.m_code_sizes.size());
+      memcpy(dst.m_code_sizes.get_ptr(), src.m_code_sizes.get_ptr(), src.m_code_sizes.size());
+   }
+
+   // Much less than a full copy moves: the code sizes are 1 of every 5 bytes per symbol, and the literal tables are skipped.
+   void lzcompressor::state::restore_pricing_state(const state& src)
+   {
+      restore_partial_state(src);
+      m_block_start_dict_ofs = src.m_block_start_dict_ofs;
+
+      for (uint i = 0; i < LZHAM_ARRAY_SIZE(m_is_match_model); i++)
+         m_is_match_model[i] = src.m_is_match_model[i];
+
+      for (uint i = 0; i < CLZBase::cNumStates; i++)
+      {
+         m_is_rep_model[i] = src.m_is_rep_model[i];
+         m_is_rep0_model[i] = src.m_is_rep0_model[i];
+         m_is_rep0_single_byte_model[i] = src.m_is_rep0_single_byte_model[i];
+         m_is_rep1_model[i] = src.m_is_rep1_model[i];
+         m_is_rep2_model[i] = src.m_is_rep2_model[i];
+      }
+
+      // The parsers price literals from their lit_price_tables. Only get_cost(), which checks them, reads the literal models.
+#if LZHAM_VERIFY_MATCH_COSTS
+      for (uint i = 0; i < (1 << CLZBase::cNumLitPredBits); i++)
+         copy_code_sizes(m_lit_table[i], src.m_lit_table[i]);
+
+      for (uint i = 0; i < (1 << CLZBase::cNumDeltaLitPredBits); i++)
+         copy_code_sizes(m_delta_lit_table[i], src.m_delta_lit_table[i]);
+#endif
+
+      copy_code_sizes(m_main_table, src.m_main_table);
+      for (uint i = 0; i < 2; i++)
+      {
+         copy_code_sizes(m_rep_len_table[i], src.m_rep_len_table[i]);
+         copy_code_sizes(m_large_len_table[i], src.m_large_len_table[i]);
+      }
+      copy_code_sizes(m_dist_lsb_table, src.m_dist_lsb_table);
+   }
+
+   void lzcompressor::lit_price_tables::refresh(const state& src)
+   {
+      for (uint i = 0; i < (1 << CLZBase::cNumLitPredBits); i++)
+         memcpy(m_lit[i], src.m_lit_table[i].m_code_sizes.get_ptr(), sizeof(m_lit[i]));
+
+      for (uint i = 0; i < (1 << CLZBase::cNumDeltaLitPredBits); i++)
+         memcpy(m_delta_lit[i], src.m_delta_lit_table[i].m_code_sizes.get_ptr(), sizeof(m_delta_lit[i]));
+   }
+
    void lzcompressor::coding_stats::clear()
    {
       m_total_bytes = 0;
@@ -967,7 +1079,7 @@ namespace lzham
 
       printf("-----------\n");
       printf("Coding statistics:\n");
-      printf("Total Bytes: %u, Total Contexts: %u, Total Cost: %f bits (%f bytes), Ave context cost: %f\n", m_total_bytes, m_total_contexts, m_total_cost, m_total_cost / 8.0f, m_total_cost / m_total_contexts);
+      printf("Total Bytes: %.0f, Total Contexts: %u, Total Cost: %f bits (%f bytes), Ave context cost: %f\n", static_cast<double>(m_total_bytes), m_total_contexts, m_total_cost, m_total_cost / 8.0f, m_total_cost / m_total_contexts);
       printf("Ave bytes per context: %f\n", m_total_bytes / (float)m_total_contexts);
 
       printf("IsMatch:\n");
@@ -1163,16 +1275,29 @@ namespace lzham
    lzcompressor::lzcompressor() :
       m_src_size(-1),
       m_src_adler32(0),
+      m_pOutput_buf(NULL),
+      m_output_buf_size(0),
+      m_output_buf_ofs(0),
       m_step(0),
       m_block_start_dict_ofs(0),
       m_block_index(0),
       m_finished(false),
-      m_num_parse_threads(0),
-      m_parse_jobs_remaining(0)
+      m_flushed_state(cFlushedNone),
+      m_pNext_block(NULL),
+      m_next_block_size(0),
+      m_effort_level(cCompressionLevelDefault),
+      m_budget_bytes(0),
+      m_budget_ticks(0),
+      m_num_parse_threads(0)
    {
       LZHAM_VERIFY( ((uint32_ptr)this & (LZHAM_GET_ALIGNMENT(lzcompressor) - 1)) == 0);
    }
 
+   lzcompressor::~lzcompressor()
+   {
+      clear();
+   }
+
    bool lzcompressor::init(const init_params& params)
    {
       clear();
@@ -1193,86 +1318,183 @@ namespace lzham
 
       const uint dict_size = 1U << m_params.m_dict_size_log2;
 
-      uint max_block_size = dict_size / 8;
-      if (m_params.m_block_size > max_block_size)
+      m_params.m_block_size = get_block_size(m_params);
+
+      m_num_parse_threads = get_num_parse_threads(m_params);
+
+      int num_parse_jobs = m_num_parse_threads - 1;
+      uint match_accel_helper_threads = LZHAM_MAX(0, (int)params.m_max_helper_threads - num_parse_jobs);
+
+      LZHAM_ASSERT(m_num_parse_threads >= 1);
+
+      if (!m_use_task_pool)
+      {
+         LZHAM_ASSERT(!match_accel_helper_threads && (m_num_parse_threads == 1));
+      }
+      else
+      {
+         LZHAM_ASSERT((match_accel_helper_threads + (m_num_parse_threads - 1)) <= params.m_max_helper_threads);
+      }
+
+      // With match finder helpers, each block's matches are found while the previous block is parsed and coded.
+      if (!m_accel.init(this, params.m_pTask_pool, match_accel_helper_threads, dict_size, m_settings.m_match_accel_max_matches_per_probe, false, m_settings.m_match_accel_max_probes, m_params.m_block_size,
+            m_settings.m_match_finder, LZHAM_MIN(m_settings.m_match_accel_hash_chain_bits, m_params.m_dict_size_log2), m_params.m_alloc_policy, m_params.m_numa_node, get_ldm_hash_bits(m_params)))
+         return false;
+
+      m_effort_level = m_params.m_compression_level;
+
+      init_position_slots(params.m_dict_size_log2);
+      init_slot_tabs();
+
+      if (!m_state.init(*this, m_settings.m_fast_adaptive_huffman_updating, m_settings.m_use_polar_codes))
+         return false;
+
+      if (!m_block_buf.try_reserve(m_params.m_block_size))
+         return false;
+
+      if (!m_comp_buf.try_reserve(m_params.m_block_size*2))
+         return false;
+
+      const uint max_parse_jobs = get_max_parse_jobs(m_params);
+      if (!m_parse_thread_state.try_reserve(max_parse_jobs))
+         return false;
+
+      for (uint i = 0; i < max_parse_jobs; i++)
       {
-         m_params.m_block_size = max_block_size;
+         parse_thread_state *pParse_state = lzham_new<parse_thread_state>();
+         if ((!pParse_state) || (!m_parse_thread_state.try_push_back(pParse_state)))
+         {
+            lzham_delete(pParse_state);
+            return false;
+         }
+
+         if (!pParse_state->m_approx_state.init(*this, m_settings.m_fast_adaptive_huffman_updating, m_settings.m_use_polar_codes))
+            return false;
       }
 
-      m_num_parse_threads = 1;
+      return seed_dictionary();
+   }
+
+   uint lzcompressor::get_block_size(const init_params& params)
+   {
+      uint max_block_size = (1U << params.m_dict_size_log2) / 8;
+      return LZHAM_MIN(params.m_block_size, max_block_size);
+   }
+
+   // One long distance match anchor per 2^cLDMAnchorBits bytes of dictionary, or 0 if long distance matching is off.
+   uint lzcompressor::get_ldm_hash_bits(const init_params& params)
+   {
+      if (!(params.m_lzham_compress_flags & LZHAM_COMP_FLAG_LONG_DISTANCE_MATCHING))
+         return 0;
+
+      return params.m_dict_size_log2 - search_accelerator::cLDMAnchorBits;
+   }
+
+   uint lzcompressor::get_num_parse_threads(const init_params& params)
+   {
+      uint num_parse_threads = 1;
 
 #if !LZHAM_FORCE_SINGLE_THREADED_PARSING
       if (params.m_max_helper_threads > 0)
       {
-         LZHAM_ASSUME(cMaxParseThreads >= 4);
-
-         if (m_params.m_block_size < 16384)
+         if (get_block_size(params) < 16384)
          {
-            m_num_parse_threads = LZHAM_MIN(cMaxParseThreads, params.m_max_helper_threads + 1);
+            num_parse_threads = params.m_max_helper_threads + 1;
          }
          else
          {
-            if ((params.m_max_helper_threads == 1) || (m_params.m_compression_level == cCompressionLevelFastest))
+            if ((params.m_max_helper_threads == 1) || (params.m_compression_level == cCompressionLevelFastest))
             {
-               m_num_parse_threads = 1;
+               num_parse_threads = 1;
             }
             else if (params.m_max_helper_threads <= 3)
             {
-               m_num_parse_threads = 2;
+               num_parse_threads = 2;
             }
             else if (params.m_max_helper_threads <= 7)
             {
-               if ((m_params.m_lzham_compress_flags & LZHAM_COMP_FLAG_EXTREME_PARSING) && (m_params.m_compression_level == cCompressionLevelUber))
-                  m_num_parse_threads = 4;
+               if ((params.m_lzham_compress_flags & LZHAM_COMP_FLAG_EXTREME_PARSING) && (params.m_compression_level == cCompressionLevelUber))
+                  num_parse_threads = 4;
                else
-                  m_num_parse_threads = 2;
+                  num_parse_threads = 2;
             }
             else
             {
-               // 8-16
-               m_num_parse_threads = 4;
+               // 4 up to 19 helpers, then a quarter of them. The rest find matches.
+               num_parse_threads = LZHAM_MAX(4U, params.m_max_helper_threads / 4);
             }
          }
       }
 #endif
 
-      int num_parse_jobs = m_num_parse_threads - 1;
-      uint match_accel_helper_threads = LZHAM_MAX(0, (int)params.m_max_helper_threads - num_parse_jobs);
+      // Each parse job gets at most cMaxParseGraphNodes bytes of the block, so more threads than that would sit idle.
+      const uint block_size = get_block_size(params);
+      return LZHAM_MIN(num_parse_threads, (block_size + cMaxParseGraphNodes - 1) / cMaxParseGraphNodes);
+   }
 
-      LZHAM_ASSERT(m_num_parse_threads >= 1);
-      LZHAM_ASSERT(m_num_parse_threads <= cMaxParseThreads);
+   // Unless parsing is deterministic, compress_block() adds a parse job for each match finder helper that has finished
+   // its part of the block.
+   uint lzcompressor::get_max_parse_jobs(const init_params& params)
+   {
+      const uint num_parse_threads = get_num_parse_threads(params);
+      if (params.m_lzham_compress_flags & LZHAM_COMP_FLAG_DETERMINISTIC_PARSING)
+         return num_parse_threads;
 
-      if (!m_use_task_pool)
-      {
-         LZHAM_ASSERT(!match_accel_helper_threads && (m_num_parse_threads == 1));
-      }
-      else
-      {
-         LZHAM_ASSERT((match_accel_helper_threads + (m_num_parse_threads - 1)) <= params.m_max_helper_threads);
-      }
+      const uint match_accel_helper_threads = LZHAM_MAX(0, (int)params.m_max_helper_threads - (int)(num_parse_threads - 1));
+      const uint block_size = get_block_size(params);
+      return LZHAM_MIN(num_parse_threads + match_accel_helper_threads, (block_size + cMaxParseGraphNodes - 1) / cMaxParseGraphNodes);
+   }
 
-      if (!m_accel.init(this, params.m_pTask_pool, match_accel_helper_threads, dict_size, m_settings.m_match_accel_max_matches_per_probe, false, m_settings.m_match_accel_max_probes))
-         return false;
+   uint64 lzcompressor::get_memory_requirements(const init_params& params)
+   {
+      if ((params.m_dict_size_log2 < CLZBase::cMinDictSizeLog2) || (params.m_dict_size_log2 > CLZBase::cMaxDictSizeLog2))
+         return 0;
+      if ((params.m_compression_level < 0) || (params.m_compression_level >= cCompressionLevelCount))
+         return 0;
 
-      init_position_slots(params.m_dict_size_log2);
-      init_slot_tabs();
+      const comp_settings &settings = s_settings[params.m_compression_level];
+      const uint block_size = get_block_size(params);
+      const uint num_parse_threads = get_num_parse_threads(params);
+      const uint max_parse_jobs = get_max_parse_jobs(params);
+      const uint match_accel_helper_threads = LZHAM_MAX(0, (int)params.m_max_helper_threads - (int)(num_parse_threads - 1));
 
-      if (!m_state.init(*this, m_settings.m_fast_adaptive_huffman_updating, m_settings.m_use_polar_codes))
-         return false;
+      uint64 total = search_accelerator::get_memory_requirements(1U << params.m_dict_size_log2, block_size, settings.m_match_accel_max_probes, match_accel_helper_threads, true,
+         settings.m_match_finder, LZHAM_MIN(settings.m_match_accel_hash_chain_bits, params.m_dict_size_log2), get_ldm_hash_bits(params));
 
-      if (!m_block_buf.try_reserve(m_params.m_block_size))
-         return false;
+      // The coding state, its copy at the start of each block, and each parse job's approximate state.
+      CLZDecompBase lzbase;
+      lzbase.init_position_slots(params.m_dict_size_log2);
+      total += static_cast<uint64>(2 + max_parse_jobs) * lzbase.get_models_memory_requirements(true);
 
-      if (!m_comp_buf.try_reserve(m_params.m_block_size*2))
-         return false;
+      total += static_cast<uint64>(max_parse_jobs) * (sizeof(parse_thread_state) + math::next_pow2_64(cMaxParseGraphNodes) * sizeof(lzdecision));
+
+      // Block buffer and compressed data staging buffer
+      total += static_cast<uint64>(block_size) * 3;
+
+      // A literal codes two symbols per byte: the is match bit and the literal.
+      total += symbol_codec::get_encoding_memory_requirements((block_size * 9) / 8, block_size * 2 + 64);
+
+      return total;
+   }
+
+   // Runs the preset dictionary through the match finder without coding it, so the first block can match against it.
+   // The decompressor preloads the same bytes into its window.
+   bool lzcompressor::seed_dictionary()
+   {
+      uint num_seed_bytes = m_params.m_num_seed_bytes;
+      if ((!num_seed_bytes) || (!m_params.m_pSeed_bytes))
+         return true;
 
-      for (uint i = 0; i < m_num_parse_threads; i++)
+      // Only the most recent dictionary-size bytes are reachable.
+      const uint dict_size = 1U << m_params.m_dict_size_log2;
+      const uint8 *pSeed_bytes = m_params.m_pSeed_bytes;
+      if (num_seed_bytes > dict_size)
       {
-         if (!m_parse_thread_state[i].m_approx_state.init(*this, m_settings.m_fast_adaptive_huffman_updating, m_settings.m_use_polar_codes))
-            return false;
+         pSeed_bytes += num_seed_bytes - dict_size;
+         num_seed_bytes = dict_size;
       }
 
-      return true;
+      return m_accel.add_seed_bytes(num_seed_bytes, pSeed_bytes, m_params.m_block_size);
    }
 
    void lzcompressor::clear()
@@ -1283,30 +1505,59 @@ namespace lzham
       m_block_buf.clear();
       m_comp_buf.clear();
 
+      m_pOutput_buf = NULL;
+      m_output_buf_size = 0;
+      m_output_buf_ofs = 0;
+
       m_step = 0;
       m_finished = false;
+      m_flushed_state = cFlushedNone;
+      m_pNext_block = NULL;
+      m_next_block_size = 0;
+      m_effort_level = cCompressionLevelDefault;
+      m_budget_bytes = 0;
+      m_budget_ticks = 0;
       m_use_task_pool = false;
       m_block_start_dict_ofs = 0;
       m_block_index = 0;
       m_state.clear();
       m_num_parse_threads = 0;
-      m_parse_jobs_remaining = 0;
 
-      for (uint i = 0; i < cMaxParseThreads; i++)
-      {
-         parse_thread_state &parse_state = m_parse_thread_state[i];
-         parse_state.m_approx_state.clear();
+      for (uint i = 0; i < m_parse_thread_state.size(); i++)
+         lzham_delete(m_parse_thread_state[i]);
+      m_parse_thread_state.clear();
+   }
 
-         for (uint j = 0; j <= cMaxParseGraphNodes; j++)
-            parse_state.m_nodes[j].clear();
+   bool lzcompressor::reset()
+   {
+      if (!m_state.reset())
+         return false;
 
-         parse_state.m_start_ofs = 0;
-         parse_state.m_bytes_to_match = 0;
-         parse_state.m_best_decisions.clear();
-         parse_state.m_issued_reset_state_partial = false;
-         parse_state.m_emit_decisions_backwards = false;
-         parse_state.m_failed = false;
-      }
+      m_accel.reset();
+      m_stats.clear();
+
+      m_src_size = 0;
+      m_src_adler32 = cInitAdler32;
+      m_block_buf.try_resize(0);
+      m_comp_buf.try_resize(0);
+
+      m_pOutput_buf = NULL;
+      m_output_buf_size = 0;
+      m_output_buf_ofs = 0;
+
+      m_step = 0;
+      m_finished = false;
+      m_flushed_state = cFlushedNone;
+      m_pNext_block = NULL;
+      m_next_block_size = 0;
+      m_block_start_dict_ofs = 0;
+      m_block_index = 0;
+
+      m_budget_bytes = 0;
+      m_budget_ticks = 0;
+      set_effort_level(m_params.m_compression_level);
+
+      return seed_dictionary();
    }
 
    bool lzcompressor::code_decision(lzdecision lzdec, uint& cur_ofs, uint& bytes_to_match)
@@ -1343,7 +1594,97 @@ namespace lzham
       return true;
    }
 
-   bool lzcompressor::put_bytes(const void* pBuf, uint buf_len)
+   // Blocks can't wrap around the end of the match finder's circular dictionary. Normally they're aligned to it, but after
+   // a flush has coded a partial block the next one is shortened to realign.
+   uint lzcompressor::get_cur_block_size() const
+   {
+      const uint dict_ofs = m_accel.get_add_pos() & (m_accel.get_max_dict_size() - 1);
+      return LZHAM_MIN(m_params.m_block_size, m_accel.get_max_dict_size() - dict_ofs);
+   }
+
+   // When the match finder prefetches, a complete block isn't coded until the block after it arrives (or the stream is
+   // flushed), so its matches can be found while the previous block is being parsed and coded.
+   bool lzcompressor::queue_block(const void* pBuf, uint buf_len)
+   {
+      if (!m_accel.get_max_prefetch_bytes())
+         return compress_block(pBuf, buf_len);
+
+      if (!m_accel.get_prefetch_size())
+         return m_accel.prefetch_bytes(buf_len, static_cast<const uint8*>(pBuf));
+
+      m_pNext_block = static_cast<const uint8*>(pBuf);
+      m_next_block_size = buf_len;
+
+      bool status = compress_block(m_accel.get_prefetch_ptr(), m_accel.get_prefetch_size());
+
+      m_pNext_block = NULL;
+      m_next_block_size = 0;
+
+      return status;
+   }
+
+   // Codes all the bytes put so far.
+   bool lzcompressor::compress_buffered_blocks()
+   {
+      if (m_block_buf.size())
+      {
+         if (!queue_block(m_block_buf.get_ptr(), m_block_buf.size()))
+            return false;
+
+         m_block_buf.try_resize(0);
+      }
+
+      if (m_accel.get_prefetch_size())
+         return compress_block(m_accel.get_prefetch_ptr(), m_accel.get_prefetch_size());
+
+      return true;
+   }
+
+   void lzcompressor::set_effort_level(compression_level level)
+   {
+      const comp_settings &settings = s_settings[level];
+
+      m_effort_level = level;
+      m_settings.m_fast_bytes = settings.m_fast_bytes;
+      m_accel.set_max_probes(settings.m_match_accel_max_matches_per_probe, settings.m_match_accel_max_probes);
+   }
+
+   // Throughput target mode: steps the effort down a level whenever the blocks coded so far have taken longer than the
+   // target allows, and back up (never above the configured level) once they're well ahead of it. The new effort applies
+   // to the blocks whose matches haven't been searched for yet.
+   void lzcompressor::update_effort_level(uint64 block_ticks, uint block_size)
+   {
+      m_budget_ticks += block_ticks;
+      m_budget_bytes += block_size;
+
+      const uint64 allowed_ticks = (m_budget_bytes * lzham_timer::get_ticks_per_sec()) / (m_params.m_target_kb_per_sec * 1024ULL);
+
+      if (m_budget_ticks > (allowed_ticks + (allowed_ticks >> 4)))
+      {
+         if (m_effort_level > cCompressionLevelFastest)
+            set_effort_level(static_cast<compression_level>(m_effort_level - 1));
+      }
+      else if (m_budget_ticks < (allowed_ticks - (allowed_ticks >> 2)))
+      {
+         if (m_effort_level < m_params.m_compression_level)
+            set_effort_level(static_cast<compression_level>(m_effort_level + 1));
+      }
+   }
+
+   // Hands the block queued behind the one being coded to the match finder, as soon as its helpers are free (or right
+   // away if wait is true).
+   bool lzcompressor::prefetch_next_block(bool wait)
+   {
+      if ((!m_pNext_block) || ((!wait) && (!m_accel.is_find_complete())))
+         return true;
+
+      const uint8* pNext_block = m_pNext_block;
+      m_pNext_block = NULL;
+
+      return m_accel.prefetch_bytes(m_next_block_size, pNext_block);
+   }
+
+   bool lzcompressor::put_bytes(const void* pBuf, size_t buf_len)
    {
       LZHAM_ASSERT(!m_finished);
       if (m_finished)
@@ -1353,14 +1694,9 @@ namespace lzham
 
       if (!pBuf)
       {
-         if (m_block_buf.size())
-         {
-            status = compress_block(m_block_buf.get_ptr(), m_block_buf.size());
+         status = compress_buffered_blocks();
 
-            m_block_buf.try_resize(0);
-         }
-
-         if (status)
+         if ((status) && (!m_params.m_omit_final_block))
          {
             if (!send_final_block())
             {
@@ -1373,27 +1709,28 @@ namespace lzham
       else
       {
          const uint8 *pSrcBuf = static_cast<const uint8*>(pBuf);
-         uint num_src_bytes_remaining = buf_len;
+         size_t num_src_bytes_remaining = buf_len;
 
          while (num_src_bytes_remaining)
          {
-            const uint num_bytes_to_copy = LZHAM_MIN(num_src_bytes_remaining, m_params.m_block_size - m_block_buf.size());
+            const uint block_size = get_cur_block_size();
+            const uint num_bytes_to_copy = static_cast<uint>(LZHAM_MIN(num_src_bytes_remaining, static_cast<size_t>(block_size - m_block_buf.size())));
 
-            if (num_bytes_to_copy == m_params.m_block_size)
+            if (num_bytes_to_copy == block_size)
             {
                LZHAM_ASSERT(!m_block_buf.size());
 
-               status = compress_block(pSrcBuf, num_bytes_to_copy);
+               status = queue_block(pSrcBuf, num_bytes_to_copy);
             }
             else
             {
                if (!m_block_buf.append(static_cast<const uint8 *>(pSrcBuf), num_bytes_to_copy)) return false;
 
-               LZHAM_ASSERT(m_block_buf.size() <= m_params.m_block_size);
+               LZHAM_ASSERT(m_block_buf.size() <= block_size);
 
-               if (m_block_buf.size() == m_params.m_block_size)
+               if (m_block_buf.size() == block_size)
                {
-                  status = compress_block(m_block_buf.get_ptr(), m_block_buf.size());
+                  status = queue_block(m_block_buf.get_ptr(), m_block_buf.size());
 
                   m_block_buf.try_resize(0);
                }
@@ -1409,6 +1746,81 @@ namespace lzham
       return status;
    }
 
+   bool lzcompressor::flush(bool reset_models)
+   {
+      LZHAM_ASSERT(!m_finished);
+      if (m_finished)
+         return false;
+
+      if ((m_block_buf.size()) || (m_accel.get_prefetch_size()))
+      {
+         if (!compress_buffered_blocks())
+            return false;
+      }
+      else if (m_flushed_state >= (reset_models ? cFlushedFull : cFlushedSync))
+      {
+         // Nothing has been coded since an equivalent flush.
+         return true;
+      }
+
+      if (!m_codec.start_encoding(16))
+         return false;
+
+      if (!m_block_index)
+      {
+         if (!send_configuration())
+            return false;
+      }
+
+      if (reset_models)
+      {
+#ifdef LZHAM_LZDEBUG
+         if (!m_codec.encode_bits(166, 12))
+            return false;
+#endif
+
+         if (!m_codec.encode_bits(cResetBlock, cBlockHeaderBits))
+            return false;
+         if (!m_codec.encode_bits(m_settings.m_fast_adaptive_huffman_updating, 1))
+            return false;
+         if (!m_codec.encode_bits(m_settings.m_use_polar_codes, 1))
+            return false;
+
+         if (!m_state.reset())
+            return false;
+      }
+
+#ifdef LZHAM_LZDEBUG
+      if (!m_codec.encode_bits(166, 12))
+         return false;
+#endif
+
+      // The sync block also gives the decompressor's Huffman decoder the few bytes of lookahead it needs to finish the
+      // previous block, and tells it to output everything decoded so far.
+      if (!m_codec.encode_bits(cRawBlock, cBlockHeaderBits))
+         return false;
+      if (!m_codec.encode_bits(cSyncBlockRawLen, 24))
+         return false;
+      if (!m_codec.encode_align_to_byte())
+         return false;
+
+      prepare_codec_output();
+
+      if (!m_codec.stop_encoding(true))
+         return false;
+
+      if (!append_codec_output())
+         return false;
+
+      m_block_index++;
+
+      m_flushed_state = reset_models ? cFlushedFull : cFlushedSync;
+
+      lzham_flush_buffered_printf();
+
+      return true;
+   }
+
    bool lzcompressor::send_final_block()
    {
       //m_codec.clear();
@@ -1436,9 +1848,42 @@ namespace lzham
       if (!m_codec.encode_bits(m_src_adler32, 32))
          return false;
 
+      prepare_codec_output();
+
       if (!m_codec.stop_encoding(true))
          return false;
 
+      if (!append_codec_output())
+         return false;
+
+      m_block_index++;
+
+#if LZHAM_UPDATE_STATS
+      m_stats.print();
+#endif
+
+      return true;
+   }
+
+   void lzcompressor::prepare_codec_output()
+   {
+      // Output must stay in order, so once anything has been staged in m_comp_buf the caller's buffer can't be used.
+      if ((m_pOutput_buf) && (m_comp_buf.empty()) && (m_output_buf_ofs < m_output_buf_size))
+      {
+         const size_t bytes_remaining = m_output_buf_size - m_output_buf_ofs;
+         m_codec.set_external_output_buf(m_pOutput_buf + m_output_buf_ofs, static_cast<uint>(LZHAM_MIN(bytes_remaining, static_cast<size_t>(UINT_MAX))));
+      }
+   }
+
+   bool lzcompressor::append_codec_output()
+   {
+      const uint external_size = m_codec.get_external_output_size();
+      if (external_size)
+      {
+         m_output_buf_ofs += external_size;
+         return true;
+      }
+
       if (m_comp_buf.empty())
       {
          m_comp_buf.swap(m_codec.get_encoding_buf());
@@ -1449,17 +1894,50 @@ namespace lzham
             return false;
       }
 
-      m_block_index++;
+      return true;
+   }
 
-#if LZHAM_UPDATE_STATS
-      m_stats.print();
+   bool lzcompressor::append_final_block(byte_vec& comp_buf, uint32 src_adler32)
+   {
+      symbol_codec codec;
+
+      if (!codec.start_encoding(16))
+         return false;
+
+#ifdef LZHAM_LZDEBUG
+      if (!codec.encode_bits(166, 12))
+         return false;
 #endif
 
-      return true;
+      if (!codec.encode_bits(cEOFBlock, cBlockHeaderBits))
+         return false;
+
+      if (!codec.encode_align_to_byte())
+         return false;
+
+      if (!codec.encode_bits(src_adler32, 32))
+         return false;
+
+      if (!codec.stop_encoding(true))
+         return false;
+
+      return comp_buf.append(codec.get_encoding_buf());
    }
 
    bool lzcompressor::send_configuration()
    {
+      if (m_params.m_reset_models_at_start)
+      {
+         // The decoder's models were left in whatever state the previous chunk ended with, so tell it to start over.
+#ifdef LZHAM_LZDEBUG
+         if (!m_codec.encode_bits(166, 12))
+            return false;
+#endif
+
+         if (!m_codec.encode_bits(cResetBlock, cBlockHeaderBits))
+            return false;
+      }
+
       if (!m_codec.encode_bits(m_settings.m_fast_adaptive_huffman_updating, 1))
          return false;
       if (!m_codec.encode_bits(m_settings.m_use_polar_codes, 1))
@@ -1468,11 +1946,128 @@ namespace lzham
       return true;
    }
 
-   // TODO: implement greedy_parse() (or flexible_parse?)
+   // Picks a single decision at cur_dict_ofs without pricing anything: the longest rep match, unless the match finder found
+   // a full match at least 2 bytes longer, then a len2 match, otherwise a literal.
+   void lzcompressor::find_greedy_decision(const state_base &cur_state, uint cur_dict_ofs, uint cur_lookahead_ofs, uint max_admissable_match_len, lzdecision &lzdec)
+   {
+      lzdec.init(cur_dict_ofs, 0, 0);
+
+      if (max_admissable_match_len < cMinMatchLen)
+         return;
+
+      uint rep_match_len = 0;
+      uint rep_match_index = 0;
+      for (uint rep_match_index_to_try = 0; rep_match_index_to_try < cMatchHistSize; rep_match_index_to_try++)
+      {
+         const uint hist_match_len = m_accel.get_match_len(cur_lookahead_ofs, cur_state.m_match_hist[rep_match_index_to_try], max_admissable_match_len);
+         if (hist_match_len > rep_match_len)
+         {
+            rep_match_len = hist_match_len;
+            rep_match_index = rep_match_index_to_try;
+         }
+      }
+
+      if (rep_match_len >= m_settings.m_fast_bytes)
+      {
+         lzdec.init(cur_dict_ofs, rep_match_len, -((int)rep_match_index + 1));
+         return;
+      }
+
+      uint full_match_len = 0;
+      uint full_match_dist = 0;
+
+      const dict_match* pMatches = m_accel.find_matches(cur_lookahead_ofs);
+      if (pMatches)
+      {
+         // Match lists are sorted by increasing length.
+         while (!pMatches->is_last())
+            pMatches++;
+
+         full_match_len = LZHAM_MIN(pMatches->get_len(), max_admissable_match_len);
+         full_match_dist = pMatches->get_dist();
+
+         // Far away 3 byte matches usually cost more than the literals they replace.
+         if ((full_match_len < 4) && (full_match_dist >= cGreedyMaxLen3MatchDist))
+            full_match_len = 0;
+      }
+
+      if ((rep_match_len >= cMinMatchLen) && ((rep_match_len + 1) >= full_match_len))
+         lzdec.init(cur_dict_ofs, rep_match_len, -((int)rep_match_index + 1));
+      else if (full_match_len > cMinMatchLen)
+         lzdec.init(cur_dict_ofs, full_match_len, full_match_dist);
+      else
+      {
+         const uint len2_match_dist = m_accel.get_len2_match(cur_lookahead_ofs);
+         if (len2_match_dist)
+            lzdec.init(cur_dict_ofs, cMinMatchLen, len2_match_dist);
+      }
+   }
+
+   // Fast parser used at the fastest level: one decision per position from find_greedy_decision(), with one step of lazy
+   // matching. Decisions are emitted forwards.
    bool lzcompressor::greedy_parse(parse_thread_state &parse_state)
    {
-      parse_state;
-      return false;
+      LZHAM_ASSERT(parse_state.m_bytes_to_match <= cMaxParseGraphNodes);
+
+      parse_state.m_failed = false;
+      parse_state.m_emit_decisions_backwards = false;
+
+      const uint bytes_to_parse = parse_state.m_bytes_to_match;
+
+      if (!parse_state.m_best_decisions.try_resize(bytes_to_parse))
+      {
+         parse_state.m_failed = true;
+         return false;
+      }
+
+      lzdecision *pDst_dec = parse_state.m_best_decisions.get_ptr();
+
+      state_base &approx_state = parse_state.m_approx_state;
+
+      const uint lookahead_start_ofs = m_accel.get_lookahead_pos() & m_accel.get_max_dict_size_mask();
+
+      uint cur_dict_ofs = parse_state.m_start_ofs;
+      uint cur_lookahead_ofs = cur_dict_ofs - lookahead_start_ofs;
+      uint cur_parse_ofs = 0;
+
+      lzdecision lzdec, next_lzdec;
+      bool have_next_lzdec = false;
+
+      while (cur_parse_ofs < bytes_to_parse)
+      {
+         const uint bytes_remaining = bytes_to_parse - cur_parse_ofs;
+
+         // A literal doesn't change the match history, so the decision found by the previous lazy check still applies.
+         if (have_next_lzdec)
+            lzdec = next_lzdec;
+         else
+            find_greedy_decision(approx_state, cur_dict_ofs, cur_lookahead_ofs, LZHAM_MIN(CLZBase::cMaxMatchLen, bytes_remaining), lzdec);
+
+         have_next_lzdec = false;
+
+         if ((lzdec.is_match()) && (static_cast<uint>(lzdec.m_len) < m_settings.m_fast_bytes) && (bytes_remaining > static_cast<uint>(lzdec.m_len)))
+         {
+            find_greedy_decision(approx_state, cur_dict_ofs + 1, cur_lookahead_ofs + 1, LZHAM_MIN(CLZBase::cMaxMatchLen, bytes_remaining - 1), next_lzdec);
+
+            if (next_lzdec.m_len > lzdec.m_len)
+            {
+               lzdec.init(cur_dict_ofs, 0, 0);
+               have_next_lzdec = true;
+            }
+         }
+
+         *pDst_dec++ = lzdec;
+         approx_state.partial_advance(lzdec);
+
+         const uint len = lzdec.get_len();
+         cur_dict_ofs += len;
+         cur_lookahead_ofs += len;
+         cur_parse_ofs += len;
+      }
+
+      parse_state.m_best_decisions.try_resize(static_cast<uint>(pDst_dec - parse_state.m_best_decisions.get_ptr()));
+
+      return true;
    }
 
    void lzcompressor::node::add_state(
@@ -1675,9 +2270,7 @@ namespace lzham
                   const uint comp_pos = static_cast<uint>((m_accel.m_lookahead_pos + cur_lookahead_ofs - dist) & m_accel.m_max_dict_size_mask);
                   const uint8* pComp = &m_accel.m_dict[comp_pos];
 
-                  for (hist_match_len = 0; hist_match_len < max_admissable_match_len; hist_match_len++)
-                     if (pComp[hist_match_len] != pLookahead[hist_match_len])
-                        break;
+                  hist_match_len = compute_match_len(pComp, pLookahead, max_admissable_match_len);
                }
 
                if (hist_match_len >= match_hist_min_match_len)
@@ -1760,7 +2353,7 @@ namespace lzham
             }
 
             // literal
-            bit_cost_t lit_cost = approx_state.get_lit_cost(m_accel, cur_dict_ofs, lit_pred0, is_match_model_index);
+            bit_cost_t lit_cost = approx_state.get_lit_cost(m_accel, cur_dict_ofs, lit_pred0, is_match_model_index, parse_state.m_lit_prices);
             bit_cost_t lit_total_cost = cur_node_total_cost + lit_cost;
             uint lit_total_complexity = cur_node_total_complexity + cLitComplexity;
 #if LZHAM_VERIFY_MATCH_COSTS
@@ -1828,24 +2421,24 @@ namespace lzham
       parse_state.m_failed = false;
       parse_state.m_emit_decisions_backwards = true;
 
-      node_state *pNodes = reinterpret_cast<node_state*>(parse_state.m_nodes);
-      pNodes[0].m_parent_index = -1;
-      pNodes[0].m_total_cost = 0;
-      pNodes[0].m_total_complexity = 0;
-
-#if 0
-      for (uint i = 1; i <= cMaxParseGraphNodes; i++)
-      {
-         pNodes[i].clear();
-      }
-#else
-      memset( &pNodes[1], 0xFF, cMaxParseGraphNodes * sizeof(node_state));
-#endif
+      // The nodes, then each reached position's partial state, are carved out of the extreme parser's node storage. Only the
+      // nodes are touched per edge, and at 16 bytes each a chunk's worth mostly stays in L1.
+      LZHAM_ASSUME((sizeof(optimal_node) + sizeof(state_base)) <= sizeof(node));
+      LZHAM_ASSUME((cMaxParseGraphNodes * cShortMatchComplexity) <= UINT16_MAX);
+      optimal_node *pNodes = reinterpret_cast<optimal_node*>(parse_state.m_nodes);
+      state_base *pNode_states = reinterpret_cast<state_base*>(pNodes + cMaxParseGraphNodes + 1);
 
       state &approx_state = parse_state.m_approx_state;
 
       const uint bytes_to_parse = parse_state.m_bytes_to_match;
 
+      pNodes[0].m_parent_index = -1;
+      pNodes[0].m_total_cost = 0;
+      pNodes[0].m_total_complexity = 0;
+
+      // No decision reaches past the end of the chunk.
+      memset(&pNodes[1], 0xFF, bytes_to_parse * sizeof(optimal_node));
+
       const uint lookahead_start_ofs = m_accel.get_lookahead_pos() & m_accel.get_max_dict_size_mask();
 
       uint cur_dict_ofs = parse_state.m_start_ofs;
@@ -1860,19 +2453,22 @@ namespace lzham
 
       while (cur_node_index < bytes_to_parse)
       {
-         node_state* pCur_node = &pNodes[cur_node_index];
+         optimal_node* pCur_node = &pNodes[cur_node_index];
 
          const uint max_admissable_match_len = LZHAM_MIN(CLZBase::cMaxMatchLen, bytes_to_parse - cur_node_index);
          const uint find_dict_size = m_accel.m_cur_dict_size + cur_lookahead_ofs;
 
          if (cur_node_index)
          {
-            LZHAM_ASSERT(pCur_node->m_parent_index >= 0);
+            const int parent_index = pCur_node->m_parent_index;
+            LZHAM_ASSERT(parent_index >= 0);
 
             // Move to this node's state using the lowest cost LZ decision found.
-            approx_state.restore_partial_state(pCur_node->m_saved_state);
-            approx_state.partial_advance(pCur_node->m_lzdec);
+            const int len = pCur_node->m_dist ? ((int)cur_node_index - parent_index) : 0;
+            approx_state.restore_partial_state(pNode_states[parent_index]);
+            approx_state.partial_advance(lzdecision(parse_state.m_start_ofs + parent_index, len, pCur_node->m_dist));
          }
+         approx_state.save_partial_state(pNode_states[cur_node_index]);
 
          const bit_cost_t cur_node_total_cost = pCur_node->m_total_cost;
          // This assert includes a fudge factor - make sure we don't overflow our scaled costs.
@@ -1897,9 +2493,7 @@ namespace lzham
                const uint comp_pos = static_cast<uint>((m_accel.m_lookahead_pos + cur_lookahead_ofs - dist) & m_accel.m_max_dict_size_mask);
                const uint8* pComp = &m_accel.m_dict[comp_pos];
 
-               for (hist_match_len = 0; hist_match_len < max_admissable_match_len; hist_match_len++)
-                  if (pComp[hist_match_len] != pLookahead[hist_match_len])
-                     break;
+               hist_match_len = compute_match_len(pComp, pLookahead, max_admissable_match_len);
             }
 
             if (hist_match_len >= match_hist_min_match_len)
@@ -1918,7 +2512,7 @@ namespace lzham
                      LZHAM_ASSERT(actual_cost == lzdec_bitcosts[l]);
                   }
 #endif
-                  node_state& dst_node = pCur_node[l];
+                  optimal_node& dst_node = pCur_node[l];
 
                   bit_cost_t rep_match_total_cost = cur_node_total_cost + lzdec_bitcosts[l];
 
@@ -1926,11 +2520,9 @@ namespace lzham
                      continue;
 
                   dst_node.m_total_cost = rep_match_total_cost;
-                  dst_node.m_total_complexity = rep_match_total_complexity;
-                  dst_node.m_parent_index = (uint16)cur_node_index;
-                  approx_state.save_partial_state(dst_node.m_saved_state);
-                  dst_node.m_lzdec.init(cur_dict_ofs, l, -((int)rep_match_index + 1));
-                  dst_node.m_lzdec.m_len = l;
+                  dst_node.m_total_complexity = (uint16)rep_match_total_complexity;
+                  dst_node.m_parent_index = (int16)cur_node_index;
+                  dst_node.m_dist = -((int)rep_match_index + 1);
                }
             }
 
@@ -1967,7 +2559,7 @@ namespace lzham
                   }
 #endif
 
-                  node_state& dst_node = pCur_node[2];
+                  optimal_node& dst_node = pCur_node[2];
 
                   bit_cost_t match_total_cost = cur_node_total_cost + cost;
                   uint match_total_complexity = cur_node_total_complexity + cShortMatchComplexity;
@@ -1975,10 +2567,9 @@ namespace lzham
                   if ((match_total_cost < dst_node.m_total_cost) || ((match_total_cost == dst_node.m_total_cost) && (match_total_complexity < dst_node.m_total_complexity)))
                   {
                      dst_node.m_total_cost = match_total_cost;
-                     dst_node.m_total_complexity = match_total_complexity;
-                     dst_node.m_parent_index = (uint16)cur_node_index;
-                     approx_state.save_partial_state(dst_node.m_saved_state);
-                     dst_node.m_lzdec.init(cur_dict_ofs, 2, len2_match_dist);
+                     dst_node.m_total_complexity = (uint16)match_total_complexity;
+                     dst_node.m_parent_index = (int16)cur_node_index;
+                     dst_node.m_dist = len2_match_dist;
                   }
 
                   max_match_len = 2;
@@ -2035,7 +2626,7 @@ namespace lzham
                         LZHAM_ASSERT(actual_cost == lzdec_bitcosts[l]);
                      }
 #endif
-                     node_state& dst_node = pCur_node[l];
+                     optimal_node& dst_node = pCur_node[l];
 
                      bit_cost_t match_total_cost = cur_node_total_cost + lzdec_bitcosts[l];
                      uint match_total_complexity = cur_node_total_complexity + match_complexity;
@@ -2044,10 +2635,9 @@ namespace lzham
                         continue;
 
                      dst_node.m_total_cost = match_total_cost;
-                     dst_node.m_total_complexity = match_total_complexity;
-                     dst_node.m_parent_index = (uint16)cur_node_index;
-                     approx_state.save_partial_state(dst_node.m_saved_state);
-                     dst_node.m_lzdec.init(cur_dict_ofs, l, match_dist);
+                     dst_node.m_total_complexity = (uint16)match_total_complexity;
+                     dst_node.m_parent_index = (int16)cur_node_index;
+                     dst_node.m_dist = match_dist;
                   }
 
                   prev_max_match_len = end_len;
@@ -2064,7 +2654,7 @@ namespace lzham
          }
 
          // literal
-         bit_cost_t lit_cost = approx_state.get_lit_cost(m_accel, cur_dict_ofs, lit_pred0, is_match_model_index);
+         bit_cost_t lit_cost = approx_state.get_lit_cost(m_accel, cur_dict_ofs, lit_pred0, is_match_model_index, parse_state.m_lit_prices);
          bit_cost_t lit_total_cost = cur_node_total_cost + lit_cost;
          uint lit_total_complexity = cur_node_total_complexity + cLitComplexity;
 #if LZHAM_VERIFY_MATCH_COSTS
@@ -2077,10 +2667,9 @@ namespace lzham
          if ((lit_total_cost < pCur_node[1].m_total_cost) || ((lit_total_cost == pCur_node[1].m_total_cost) && (lit_total_complexity < pCur_node[1].m_total_complexity)))
          {
             pCur_node[1].m_total_cost = lit_total_cost;
-            pCur_node[1].m_total_complexity = lit_total_complexity;
+            pCur_node[1].m_total_complexity = (uint16)lit_total_complexity;
             pCur_node[1].m_parent_index = (int16)cur_node_index;
-            approx_state.save_partial_state(pCur_node[1].m_saved_state);
-            pCur_node[1].m_lzdec.init(cur_dict_ofs, 0, 0);
+            pCur_node[1].m_dist = 0;
          }
 
          cur_dict_ofs++;
@@ -2102,11 +2691,13 @@ namespace lzham
       do
       {
          LZHAM_ASSERT((node_index >= 0) && (node_index <= (int)cMaxParseGraphNodes));
-         node_state& cur_node = pNodes[node_index];
+         const optimal_node& cur_node = pNodes[node_index];
+         const int parent_index = cur_node.m_parent_index;
 
-         *pDst_dec++ = cur_node.m_lzdec;
+         pDst_dec->init(parse_state.m_start_ofs + parent_index, cur_node.m_dist ? (node_index - parent_index) : 0, cur_node.m_dist);
+         pDst_dec++;
 
-         node_index = cur_node.m_parent_index;
+         node_index = parent_index;
 
       } while (node_index > 0);
 
@@ -2122,24 +2713,14 @@ namespace lzham
 
       (void)pData_ptr;
 
-      parse_thread_state &parse_state = m_parse_thread_state[parse_job_index];
+      parse_thread_state &parse_state = *m_parse_thread_state[parse_job_index];
 
-#if 0
-      if (m_params.m_compression_level == cCompressionLevelFastest)
+      if (m_effort_level == cCompressionLevelFastest)
          greedy_parse(parse_state);
-      else
-#endif
-      if ((m_params.m_lzham_compress_flags & LZHAM_COMP_FLAG_EXTREME_PARSING) && (m_params.m_compression_level == cCompressionLevelUber))
+      else if ((m_params.m_lzham_compress_flags & LZHAM_COMP_FLAG_EXTREME_PARSING) && (m_effort_level == cCompressionLevelUber))
          extreme_parse(parse_state);
       else
          optimal_parse(parse_state);
-
-      LZHAM_MEMORY_EXPORT_BARRIER
-
-      if (atomic_decrement32(&m_parse_jobs_remaining) == 0)
-      {
-         m_parse_jobs_complete.release();
-      }
    }
 
    bool lzcompressor::compress_block(const void* pBuf, uint buf_len)
@@ -2153,6 +2734,8 @@ namespace lzham
       if (m_src_size < 0)
          return false;
 
+      const timer_ticks start_ticks = m_params.m_target_kb_per_sec ? lzham_timer::get_ticks() : 0;
+
       m_src_size += buf_len;
 
       if (!m_accel.add_bytes_begin(buf_len, static_cast<const uint8*>(pBuf)))
@@ -2230,6 +2813,9 @@ namespace lzham
 
       while (bytes_to_match)
       {
+         if (!prefetch_next_block(false))
+            return false;
+
          uint num_parse_jobs = LZHAM_MIN(m_num_parse_threads, (bytes_to_match + cMaxParseGraphNodes - 1) / cMaxParseGraphNodes);
          if ((m_params.m_lzham_compress_flags & LZHAM_COMP_FLAG_DETERMINISTIC_PARSING) == 0)
          {
@@ -2237,7 +2823,7 @@ namespace lzham
             {
                // Increase the number of parser threads as the match finder finishes up.
                num_parse_jobs += m_accel.get_num_completed_helper_threads();
-               num_parse_jobs = LZHAM_MIN(num_parse_jobs, cMaxParseThreads);
+               num_parse_jobs = LZHAM_MIN(num_parse_jobs, m_parse_thread_state.size());
             }
          }
          if (bytes_to_match < 1536)
@@ -2261,9 +2847,17 @@ namespace lzham
          uint parse_thread_remaining = parse_thread_total_size;
          for (uint parse_thread_index = 0; parse_thread_index < num_parse_jobs; parse_thread_index++)
          {
-            parse_thread_state &parse_thread = m_parse_thread_state[parse_thread_index];
+            parse_thread_state &parse_thread = *m_parse_thread_state[parse_thread_index];
 
-            parse_thread.m_approx_state = m_state;
+            // The greedy parser doesn't price anything, so it only needs the match history, not the models. The others only
+            // need the prices.
+            if (m_effort_level == cCompressionLevelFastest)
+               parse_thread.m_approx_state.restore_partial_state(m_state);
+            else
+            {
+               parse_thread.m_approx_state.restore_pricing_state(m_state);
+               parse_thread.m_lit_prices.refresh(m_state);
+            }
             parse_thread.m_approx_state.m_cur_ofs = parse_thread_start_ofs;
 
             if (parse_thread_index > 0)
@@ -2294,12 +2888,10 @@ namespace lzham
 
             if ((m_use_task_pool) && (num_parse_jobs > 1))
             {
-               m_parse_jobs_remaining = num_parse_jobs;
-
                {
                   scoped_perf_section queue_task_timer("queing parse tasks");
 
-                  if (!m_params.m_pTask_pool->queue_multiple_object_tasks(this, &lzcompressor::parse_job_callback, 1, num_parse_jobs - 1))
+                  if (!m_params.m_pTask_pool->queue_multiple_object_tasks(this, &lzcompressor::parse_job_callback, 1, num_parse_jobs - 1, NULL, &m_parse_task_group))
                      return false;
                }
 
@@ -2308,12 +2900,13 @@ namespace lzham
                {
                   scoped_perf_section wait_timer("waiting for jobs");
 
-                  m_parse_jobs_complete.wait();
+                  // Picks up any of our parse jobs the (possibly shared) pool hasn't started yet, then sleeps until the
+                  // rest are done.
+                  m_params.m_pTask_pool->join(&m_parse_task_group);
                }
             }
             else
             {
-               m_parse_jobs_remaining = INT_MAX;
                for (uint parse_thread_index = 0; parse_thread_index < num_parse_jobs; parse_thread_index++)
                {
                   parse_job_callback(parse_thread_index, NULL);
@@ -2326,7 +2919,7 @@ namespace lzham
 
             for (uint parse_thread_index = 0; parse_thread_index < num_parse_jobs; parse_thread_index++)
             {
-               parse_thread_state &parse_thread = m_parse_thread_state[parse_thread_index];
+               parse_thread_state &parse_thread = *m_parse_thread_state[parse_thread_index];
                if (parse_thread.m_failed)
                   return false;
 
@@ -2353,7 +2946,7 @@ namespace lzham
                      dec_step = -1;
                   }
 
-                  LZHAM_ASSERT(best_decisions.back().m_pos == (int)parse_thread.m_start_ofs);
+                  LZHAM_ASSERT(best_decisions[(parse_thread.m_emit_decisions_backwards) ? (best_decisions.size() - 1) : 0].m_pos == (int)parse_thread.m_start_ofs);
 
                   // Loop rearranged to avoid bad x64 codegen problem with MSVC2008.
                   for ( ; ; )
@@ -2382,6 +2975,9 @@ namespace lzham
          }
       }
 
+      if (!prefetch_next_block(true))
+         return false;
+
       {
          scoped_perf_section add_bytes_timer("add_bytes_end");
          m_accel.add_bytes_end();
@@ -2394,12 +2990,14 @@ namespace lzham
       if (!m_codec.encode_bits(366, 12)) return false;
 #endif
 
+      prepare_codec_output();
+
       {
          scoped_perf_section stop_encoding_timer("stop_encoding");
          if (!m_codec.stop_encoding(true)) return false;
       }
 
-      uint compressed_size = m_codec.get_encoding_buf().size();
+      uint compressed_size = m_codec.get_encoding_size();
       compressed_size;
 
 #if defined(LZHAM_DISABLE_RAW_BLOCKS) || defined(LZHAM_LZDEBUG)
@@ -2428,7 +3026,7 @@ namespace lzham
 
          if (!m_codec.encode_bits(cRawBlock, cBlockHeaderBits)) return false;
 
-         LZHAM_ASSERT(buf_len <= 0x1000000);
+         LZHAM_ASSERT(buf_len <= cSyncBlockRawLen);
          if (!m_codec.encode_bits(buf_len - 1, 24)) return false;
          if (!m_codec.encode_align_to_byte()) return false;
 
@@ -2439,28 +3037,28 @@ namespace lzham
             if (!m_codec.encode_bits(*pSrc++, 8)) return false;
          }
 
+         prepare_codec_output();
+
          if (!m_codec.stop_encoding(true)) return false;
       }
 
       {
          scoped_perf_section append_timer("append");
 
-         if (m_comp_buf.empty())
-         {
-            m_comp_buf.swap(m_codec.get_encoding_buf());
-         }
-         else
-         {
-            if (!m_comp_buf.append(m_codec.get_encoding_buf()))
-               return false;
-         }
+         if (!append_codec_output())
+            return false;
       }
 #if LZHAM_UPDATE_STATS
-      LZHAM_VERIFY(m_stats.m_total_bytes == m_src_size);
+      LZHAM_VERIFY(static_cast<int64>(m_stats.m_total_bytes) == m_src_size);
 #endif
 
       m_block_index++;
 
+      m_flushed_state = cFlushedNone;
+
+      if (m_params.m_target_kb_per_sec)
+         update_effort_level(lzham_timer::get_ticks() - start_ticks, buf_len);
+
       return true;
    }
 
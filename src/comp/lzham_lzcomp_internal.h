@@ -10,7 +10,6 @@ namespace lzham
    typedef lzham::vector<uint8> byte_vec;
 
    const uint cMaxParseGraphNodes = 3072;
-   const uint cMaxParseThreads = 8;
 
    enum compression_level
    {
@@ -30,12 +29,15 @@ namespace lzham
       bool m_use_polar_codes;
       uint m_match_accel_max_matches_per_probe;
       uint m_match_accel_max_probes;
+      search_accelerator::match_finder_type m_match_finder;
+      uint m_match_accel_hash_chain_bits;
    };
       
    class lzcompressor : public CLZBase
    {
    public:
       lzcompressor();
+      ~lzcompressor();
 
       struct init_params
       {
@@ -54,7 +56,16 @@ namespace lzham
             m_block_size(cDefaultBlockSize),
             m_num_cachelines(0),
             m_cacheline_size(0),
-            m_lzham_compress_flags(0)
+            m_lzham_compress_flags(0),
+            m_reset_models_at_start(false),
+            m_omit_final_block(false),
+            m_num_seed_bytes(0),
+            m_pSeed_bytes(NULL),
+            m_target_kb_per_sec(0),
+            m_alloc_policy(0),
+            m_numa_node(0),
+            m_num_helper_cpus(0),
+            m_pHelper_cpus(NULL)
          {
          }
 
@@ -70,18 +81,57 @@ namespace lzham
          uint m_cacheline_size;
          
          uint m_lzham_compress_flags;
+
+         // Independent chunk support: begin with a reset block instead of the stream configuration, and/or don't send the EOF block when flushed.
+         bool m_reset_models_at_start;
+         bool m_omit_final_block;
+
+         // Preset dictionary, loaded into the match finder's window before the first block. Must remain valid until the compressor is destroyed.
+         uint m_num_seed_bytes;
+         const uint8 *m_pSeed_bytes;
+
+         // If nonzero, the effort is adjusted after each block to compress at about this many KB per second, never
+         // exceeding m_compression_level.
+         uint m_target_kb_per_sec;
+
+         // How the match finder's dictionary and tables are allocated (lzham_alloc_policy_flags).
+         uint m_alloc_policy;
+         uint m_numa_node;
+
+         // The CPUs a compressor's own helper threads may run on (none=any).
+         uint m_num_helper_cpus;
+         const uint *m_pHelper_cpus;
       };
 
       bool init(const init_params& params);
       void clear();
 
-      bool put_bytes(const void* pBuf, uint buf_len);
+      // Estimated peak heap bytes used by a compressor initialized with these parameters (the object itself isn't included).
+      static uint64 get_memory_requirements(const init_params& params);
+
+      // Prepares for a new stream with the same parameters, keeping all allocations.
+      bool reset();
+
+      bool put_bytes(const void* pBuf, size_t buf_len);
+
+      // Codes any buffered bytes as a (short) block, then emits an empty sync block so the decompressor can output everything
+      // put so far without more input. If reset_models is true the coding models are reset too. The dictionary is kept.
+      bool flush(bool reset_models);
 
       const byte_vec& get_compressed_data() const   { return m_comp_buf; }
             byte_vec& get_compressed_data()         { return m_comp_buf; }
 
+      // Optional caller supplied output buffer. While set, blocks are written straight into it for as long as they fit; once
+      // one doesn't, it and everything after it is staged in the compressed data buffer instead (so get_output_buf_ofs()
+      // bytes always precede get_compressed_data()).
+      void set_output_buf(uint8 *pBuf, size_t buf_size) { m_pOutput_buf = pBuf; m_output_buf_size = buf_size; m_output_buf_ofs = 0; }
+      size_t get_output_buf_ofs() const { return m_output_buf_ofs; }
+
       uint32 get_src_adler32() const { return m_src_adler32; }
 
+      // Appends a standalone EOF block, used to terminate a stream assembled from independently compressed chunks.
+      static bool append_final_block(byte_vec& comp_buf, uint32 src_adler32);
+
    private:
       class state;
       
@@ -97,6 +147,9 @@ namespace lzham
          cShortMatchComplexity = 7
       };
 
+      // The greedy parser ignores 3 byte matches at least this far away.
+      enum { cGreedyMaxLen3MatchDist = 8192 };
+
       struct lzdecision
       {
          int m_pos;  // dict position where decision was evaluated
@@ -175,6 +228,16 @@ namespace lzham
          }
       };
 
+      // Every literal context's code sizes, laid out flat so the parsers price a literal with one load instead of going through
+      // the context's model. A parse job refreshes its copy whenever it takes a new pricing snapshot of the coding state.
+      struct lit_price_tables
+      {
+         uint8 m_lit[1 << CLZBase::cNumLitPredBits][256];
+         uint8 m_delta_lit[1 << CLZBase::cNumDeltaLitPredBits][256];
+
+         void refresh(const state& src);
+      };
+
       class state : public state_base
       {
       public:
@@ -183,10 +246,12 @@ namespace lzham
          void clear();
 
          bool init(CLZBase& lzbase, bool fast_adaptive_huffman_updating, bool use_polar_codes);
+         bool reset();
+         void reset_bit_models();
 
          bit_cost_t get_cost(CLZBase& lzbase, const search_accelerator& dict, const lzdecision& lzdec) const;
          bit_cost_t get_len2_match_cost(CLZBase& lzbase, uint dict_pos, uint len2_match_dist, uint is_match_model_index);
-         bit_cost_t get_lit_cost(const search_accelerator& dict, uint dict_pos, uint lit_pred0, uint is_match_model_index) const;
+         bit_cost_t get_lit_cost(const search_accelerator& dict, uint dict_pos, uint lit_pred0, uint is_match_model_index, const lit_price_tables& lit_prices) const;
 
          // Returns actual cost.
          void get_rep_match_costs(uint dict_pos, bit_cost_t *pBitcosts, uint match_hist_index, int min_len, int max_len, uint is_match_model_index) const;
@@ -205,6 +270,11 @@ namespace lzham
          void reset_state_partial();
          void start_of_block(const search_accelerator& dict, uint cur_ofs, uint block_index);
 
+         // Copies only what the parsers read from src: the partial state, the bit models and each table's code sizes (except the
+         // literal tables, which the parsers read from a lit_price_tables). The symbol frequencies and codes are left stale, so
+         // this state can price decisions but must not code or update them.
+         void restore_pricing_state(const state& src);
+
          uint get_pred_char(const search_accelerator& dict, int pos, int backward_ofs) const;
 
          inline bool will_reference_last_match(const lzdecision& lzdec) const
@@ -241,7 +311,7 @@ namespace lzham
          void update(const lzdecision& lzdec, const state& cur_state, const search_accelerator& dict, bit_cost_t cost);
          void print();
 
-         uint m_total_bytes;
+         uint64 m_total_bytes;
          uint m_total_contexts;
          double m_total_cost;
 
@@ -303,6 +373,10 @@ namespace lzham
       byte_vec m_block_buf;
       byte_vec m_comp_buf;
 
+      uint8 *m_pOutput_buf;
+      size_t m_output_buf_size;
+      size_t m_output_buf_ofs;
+
       uint m_step;
 
       uint m_block_start_dict_ofs;
@@ -311,6 +385,20 @@ namespace lzham
 
       bool m_finished;
       bool m_use_task_pool;
+
+      // What the most recent flush() did, cleared whenever another block is coded. Lets redundant flushes be skipped.
+      enum { cFlushedNone, cFlushedSync, cFlushedFull };
+      uint m_flushed_state;
+
+      // The block queued behind the one compress_block() is coding, which is prefetched once the match finder is free.
+      const uint8* m_pNext_block;
+      uint m_next_block_size;
+
+      // Throughput target mode: the settings row currently in effect (at most m_params.m_compression_level), and the
+      // bytes coded and time spent in compress_block() so far.
+      compression_level m_effort_level;
+      uint64 m_budget_bytes;
+      uint64 m_budget_ticks;
       
       struct node_state
       {
@@ -351,6 +439,17 @@ namespace lzham
          void add_state(int parent_index, int parent_state_index, const lzdecision &lzdec, state &parent_state, bit_cost_t total_cost, uint total_complexity);
       };
 
+      // The optimal parser's per position node: the cheapest way found so far to reach it. The decision that leads here starts
+      // at the parent's position, and is a literal if m_dist is 0, otherwise a match of (this - parent) bytes. The coding state
+      // isn't kept per node: it's rebuilt from the parent's saved state when the parser reaches the node.
+      struct optimal_node
+      {
+         bit_cost_t m_total_cost;
+         int m_dist;
+         uint16 m_total_complexity;
+         int16 m_parent_index;
+      };
+
       state m_initial_state;                    // state at start of block
       
       state m_state;                            // main thread's current coding state
@@ -361,6 +460,7 @@ namespace lzham
          uint m_bytes_to_match;
 
          state m_approx_state;
+         lit_price_tables m_lit_prices;
 
          node m_nodes[cMaxParseGraphNodes + 1];
                   
@@ -378,13 +478,28 @@ namespace lzham
       };
 
       uint m_num_parse_threads;
-      parse_thread_state m_parse_thread_state[cMaxParseThreads];
-
-      volatile atomic32_t m_parse_jobs_remaining;
-      semaphore m_parse_jobs_complete;
 
+      // One state per parse job a round can have, including the extra jobs added as match finder helpers finish.
+      lzham::vector<parse_thread_state*> m_parse_thread_state;
+
+      task_pool::task_group m_parse_task_group;
+
+      static uint get_block_size(const init_params& params);
+      static uint get_ldm_hash_bits(const init_params& params);
+      static uint get_num_parse_threads(const init_params& params);
+      static uint get_max_parse_jobs(const init_params& params);
+      uint get_cur_block_size() const;
+      bool queue_block(const void* pBuf, uint buf_len);
+      bool compress_buffered_blocks();
+      bool prefetch_next_block(bool wait);
+      void set_effort_level(compression_level level);
+      void update_effort_level(uint64 block_ticks, uint block_size);
+      void prepare_codec_output();
+      bool append_codec_output();
       bool send_final_block();
       bool send_configuration();
+      bool seed_dictionary();
+      void find_greedy_decision(const state_base &cur_state, uint cur_dict_ofs, uint cur_lookahead_ofs, uint max_admissable_match_len, lzdecision &lzdec);
       bool greedy_parse(parse_thread_state &parse_state);
       bool extreme_parse(parse_thread_state &parse_state);
       bool optimal_parse(parse_thread_state &parse_state);
@@ -16,6 +16,13 @@ namespace lzham
       return (c0 | (c1 << 8)) ^ (c2 << 4);
    }
 
+   // Extends a 3 byte hash with (32 - shift) more bits computed from all 4 bytes. Bits 0-15 are left as is.
+   static inline uint32 hash4_from_hash3(uint32 h3, uint c0, uint c1, uint c2, uint c3, uint shift)
+   {
+      const uint32 x = (c0 | (c1 << 8) | (c2 << 16) | (c3 << 24)) * 0x9E3779B1U;
+      return h3 | (static_cast<uint32>(static_cast<uint64>(x) >> shift) << 16);
+   }
+
    search_accelerator::search_accelerator() :
       m_pLZBase(NULL),
       m_pTask_pool(NULL),
@@ -25,55 +32,196 @@ namespace lzham
       m_lookahead_pos(0),
       m_lookahead_size(0),
       m_cur_dict_size(0),
-      m_fill_lookahead_pos(0),
-      m_fill_lookahead_size(0),
-      m_fill_dict_size(0),
+      m_match_finder(cMatchFinderBinaryTree),
+      m_chain_hash_shift(32),
+      m_cur_match_block(0),
+      m_ldm_hash_shift(0),
+      m_ldm_rolling_hash(0),
+      m_ldm_num_hashed_bytes(0),
       m_max_probes(0),
       m_max_matches(0),
+      m_init_max_probes(0),
       m_all_matches(false),
-      m_next_match_ref(0),
-      m_num_completed_helper_threads(0)
+      m_max_prefetch_bytes(0),
+      m_prefetch_size(0)
+   {
+   }
+
+   search_accelerator::~search_accelerator()
    {
+      // A prefetched block's helper tasks may still be running.
+      if (m_pTask_pool)
+         m_pTask_pool->join(&m_task_group);
    }
 
-   bool search_accelerator::init(CLZBase* pLZBase, task_pool* pPool, uint max_helper_threads, uint max_dict_size, uint max_matches, bool all_matches, uint max_probes)
+   bool search_accelerator::init(CLZBase* pLZBase, task_pool* pPool, uint max_helper_threads, uint max_dict_size, uint max_matches, bool all_matches, uint max_probes, uint max_prefetch_bytes, match_finder_type finder, uint hash_chain_bits, uint alloc_policy, uint numa_node, uint ldm_hash_bits)
    {
       LZHAM_ASSERT(pLZBase);
       LZHAM_ASSERT(max_dict_size && math::is_power_of_2(max_dict_size));
       LZHAM_ASSERT(max_probes);
 
-      m_max_probes = LZHAM_MIN(cMatchAccelMaxSupportedProbes, max_probes);
+      if (m_pTask_pool)
+         m_pTask_pool->join(&m_task_group);
 
       m_pLZBase = pLZBase;
       m_pTask_pool = max_helper_threads ? pPool : NULL;
-      m_max_helper_threads = m_pTask_pool ? max_helper_threads : 0;
-      m_max_matches = LZHAM_MIN(m_max_probes, max_matches);
+      // m_hash_thread_index stores the helper that owns each hash in 16 bits.
+      LZHAM_ASSUME(LZHAM_MAX_HELPER_THREADS < UINT16_MAX);
+      m_max_helper_threads = m_pTask_pool ? LZHAM_MIN(max_helper_threads, LZHAM_MAX_HELPER_THREADS) : 0;
+      m_init_max_probes = LZHAM_MIN(cMatchAccelMaxSupportedProbes, max_probes);
+      set_max_probes(max_matches, max_probes);
       m_all_matches = all_matches;
 
       m_max_dict_size = max_dict_size;
       m_max_dict_size_mask = m_max_dict_size - 1;
-      m_cur_dict_size = 0;
-      m_lookahead_size = 0;
-      m_lookahead_pos = 0;
-      m_fill_lookahead_pos = 0;
-      m_fill_lookahead_size = 0;
-      m_fill_dict_size = 0;
-      m_num_completed_helper_threads = 0;
 
-      if (!m_dict.try_resize_no_construct(max_dict_size + CLZBase::cMaxMatchLen))
+      // Prefetching only pays off if the helper threads have something else to do while the current block is parsed.
+      m_max_prefetch_bytes = m_pTask_pool ? max_prefetch_bytes : 0;
+      LZHAM_ASSERT(m_max_prefetch_bytes <= (max_dict_size / 4));
+
+      if (!m_dict.try_resize_no_construct(max_dict_size + CLZBase::cMaxMatchLen, alloc_policy, numa_node))
          return false;
 
       if (!m_hash.try_resize_no_construct(cHashSize))
          return false;
 
-      if (!m_nodes.try_resize_no_construct(max_dict_size))
-         return false;
+      m_match_finder = finder;
+      if (m_match_finder == cMatchFinderHashChain)
+      {
+         hash_chain_bits = math::clamp<uint>(hash_chain_bits, cMinHashChainBits, cMaxHashChainBits);
+         m_chain_hash_shift = 32 - (hash_chain_bits - cMinHashChainBits);
 
-      memset(m_hash.get_ptr(), 0, m_hash.size_in_bytes());
+         m_nodes.clear();
+
+         if (!m_chain_hash.try_resize_no_construct(1U << hash_chain_bits, alloc_policy, numa_node))
+            return false;
+
+         if (!m_chain.try_resize_no_construct(max_dict_size, alloc_policy, numa_node))
+            return false;
+      }
+      else
+      {
+         m_chain_hash.clear();
+         m_chain.clear();
+
+         if (!m_nodes.try_resize_no_construct(max_dict_size, alloc_policy, numa_node))
+            return false;
+      }
+
+      if (ldm_hash_bits)
+      {
+         ldm_hash_bits = math::clamp<uint>(ldm_hash_bits, cMinLDMHashBits, cMaxLDMHashBits);
+
+         // Anchors have the top cLDMAnchorBits of the rolling hash clear, so the table is indexed by the bits below them.
+         m_ldm_hash_shift = 64 - cLDMAnchorBits - ldm_hash_bits;
+
+         if (!m_ldm_hash.try_resize_no_construct(1U << ldm_hash_bits, alloc_policy, numa_node))
+            return false;
+
+         // The rolling hash adds a random 64-bit value per byte. A fixed xorshift sequence keeps the output deterministic.
+         uint64 x = 0x2545F4914F6CDD1DULL;
+         for (uint i = 0; i < 256; i++)
+         {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            m_ldm_gear[i] = x;
+         }
+      }
+      else
+      {
+         m_ldm_hash.clear();
+
+         for (uint i = 0; i < LZHAM_ARRAY_SIZE(m_match_blocks); i++)
+            m_match_blocks[i].m_ldm_dists.clear();
+      }
+
+      reset();
 
       return true;
    }
 
+   void search_accelerator::reset()
+   {
+      if (m_pTask_pool)
+         m_pTask_pool->join(&m_task_group);
+
+      m_cur_dict_size = 0;
+      m_lookahead_size = 0;
+      m_lookahead_pos = 0;
+      m_prefetch_size = 0;
+      m_cur_match_block = 0;
+
+      for (uint i = 0; i < LZHAM_ARRAY_SIZE(m_match_blocks); i++)
+      {
+         match_block &blk = m_match_blocks[i];
+         blk.m_lookahead_pos = 0;
+         blk.m_lookahead_size = 0;
+         blk.m_dict_size = 0;
+         blk.m_num_completed_helper_threads = 0;
+         blk.m_next_match_ref = 0;
+      }
+
+      memset(m_hash.get_ptr(), 0, m_hash.size_in_bytes());
+
+      if (m_chain_hash.size())
+         memset(m_chain_hash.get_ptr(), 0, m_chain_hash.size_in_bytes());
+
+      if (m_digram_hash.size())
+         memset(m_digram_hash.get_ptr(), 0, m_digram_hash.size_in_bytes());
+
+      if (m_ldm_hash.size())
+         memset(m_ldm_hash.get_ptr(), 0, m_ldm_hash.size_in_bytes());
+
+      m_ldm_rolling_hash = 0;
+      m_ldm_num_hashed_bytes = 0;
+   }
+
+   void search_accelerator::set_max_probes(uint max_matches, uint max_probes)
+   {
+      LZHAM_ASSERT((max_probes) && (LZHAM_MIN(cMatchAccelMaxSupportedProbes, max_probes) <= m_init_max_probes));
+
+      m_max_probes = LZHAM_MIN(m_init_max_probes, max_probes);
+      m_max_matches = LZHAM_MIN(m_max_probes, max_matches);
+   }
+
+   uint64 search_accelerator::get_memory_requirements(uint max_dict_size, uint max_add_bytes, uint max_probes, uint max_helper_threads, bool prefetching, match_finder_type finder, uint hash_chain_bits, uint ldm_hash_bits)
+   {
+      max_probes = LZHAM_MIN(cMatchAccelMaxSupportedProbes, max_probes);
+
+      uint64 total = max_dict_size + CLZBase::cMaxMatchLen;
+      total += cHashSize * sizeof(uint);
+
+      if (finder == cMatchFinderHashChain)
+      {
+         hash_chain_bits = math::clamp<uint>(hash_chain_bits, cMinHashChainBits, cMaxHashChainBits);
+         total += (1ULL << hash_chain_bits) * sizeof(uint);
+         total += static_cast<uint64>(max_dict_size) * sizeof(uint);
+      }
+      else
+      {
+         total += static_cast<uint64>(max_dict_size) * sizeof(node);
+      }
+
+      // Per block match lists, for both the current and the prefetched block
+      const uint num_match_blocks = (prefetching && max_helper_threads) ? 2 : 1;
+      total += num_match_blocks * static_cast<uint64>(max_probes) * max_add_bytes * sizeof(dict_match);
+      total += num_match_blocks * static_cast<uint64>(max_add_bytes) * sizeof(atomic32_t);
+      total += cDigramHashSize * sizeof(uint) + num_match_blocks * static_cast<uint64>(max_add_bytes) * sizeof(uint);
+
+      if (ldm_hash_bits)
+      {
+         ldm_hash_bits = math::clamp<uint>(ldm_hash_bits, cMinLDMHashBits, cMaxLDMHashBits);
+         total += (1ULL << ldm_hash_bits) * sizeof(uint) + num_match_blocks * static_cast<uint64>(max_add_bytes) * sizeof(uint);
+      }
+
+      // The thread index and counts of each hash, and a block's distinct and common hashes.
+      if (max_helper_threads)
+         total += 0x10000 * (sizeof(uint16) + sizeof(uint)) + static_cast<uint64>(max_add_bytes) * sizeof(uint16) + (max_add_bytes / 2) * sizeof(uint16);
+
+      return total;
+   }
+
    uint search_accelerator::get_max_add_bytes() const
    {
       uint add_pos = static_cast<uint>(m_lookahead_pos & (m_max_dict_size - 1));
@@ -100,18 +248,108 @@ namespace lzham
       4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
    };
 
+   // Called with two matches of the same length. Replaces best_match with the one delta_pos bytes back if it's cheaper to code.
+   inline void search_accelerator::update_equal_len_match(dict_match &best_match, uint insert_pos, const uint8* pIns, const uint8* pComp, uint delta_pos, uint match_len, uint max_match_len) const
+   {
+      LZHAM_ASSERT(best_match.get_len() == match_len);
+
+      uint bestMatchDist = best_match.m_dist;
+      uint compMatchDist = delta_pos;
+
+      uint bestMatchSlot, bestMatchSlotOfs;
+      m_pLZBase->compute_lzx_position_slot(bestMatchDist, bestMatchSlot, bestMatchSlotOfs);
+
+      uint compMatchSlot, compMatchOfs;
+      m_pLZBase->compute_lzx_position_slot(compMatchDist, compMatchSlot, compMatchOfs);
+
+      // If both matches uses the same match slot, choose the one with the offset containing the lowest nibble as these bits separately entropy coded.
+      // This could choose a match which is further away in the absolute sense, but closer in a coding sense.
+      if ( (compMatchSlot < bestMatchSlot) ||
+         ((compMatchSlot >= 8) && (compMatchSlot == bestMatchSlot) && ((compMatchOfs & 15) < (bestMatchSlotOfs & 15))) )
+      {
+         best_match.m_dist = delta_pos;
+      }
+      else if ((match_len < max_match_len) && (compMatchSlot <= bestMatchSlot))
+      {
+         // Choose the match which has lowest hamming distance in the mismatch byte for a tiny win on binary files.
+         // TODO: This competes against the prev. optimization.
+         uint desired_mismatch_byte = pIns[match_len];
+
+         uint cur_mismatch_byte = m_dict[(insert_pos - bestMatchDist + match_len) & m_max_dict_size_mask];
+         uint cur_mismatch_dist = g_hamming_dist[cur_mismatch_byte ^ desired_mismatch_byte];
+
+         uint new_mismatch_byte = pComp[match_len];
+         uint new_mismatch_dist = g_hamming_dist[new_mismatch_byte ^ desired_mismatch_byte];
+         if (new_mismatch_dist < cur_mismatch_dist)
+            best_match.m_dist = delta_pos;
+      }
+   }
+
+   // Copies the longest (up to m_max_matches) of the matches found at lookahead_pos to the block's match list, and
+   // publishes them to find_matches().
+   inline void search_accelerator::publish_matches(match_block& blk, uint lookahead_pos, dict_match* pMatches, uint num_matches)
+   {
+      // Append the long distance match covering this position if it's longer than anything the finder found. pMatches
+      // always has room for one more.
+      if (blk.m_ldm_dists.size())
+      {
+         const uint lookahead_ofs = lookahead_pos - blk.m_lookahead_pos;
+         const uint dist = blk.m_ldm_dists[lookahead_ofs];
+         if (dist)
+         {
+            const uint max_match_len = LZHAM_MIN(CLZBase::cMaxMatchLen, blk.m_lookahead_size - lookahead_ofs);
+            const uint match_len = compute_match_len(&m_dict[(lookahead_pos - dist) & m_max_dict_size_mask], &m_dict[lookahead_pos & m_max_dict_size_mask], max_match_len);
+
+            if (match_len > (num_matches ? pMatches[num_matches - 1].get_len() : static_cast<uint>(CLZBase::cMinMatchLen)))
+            {
+               pMatches[num_matches].m_len = static_cast<uint8>(match_len - CLZBase::cMinMatchLen);
+               pMatches[num_matches].m_dist = dist;
+               num_matches++;
+            }
+         }
+      }
+
+      if (num_matches)
+      {
+         pMatches[num_matches - 1].m_dist |= 0x80000000;
+
+         const uint num_matches_to_write = LZHAM_MIN(num_matches, blk.m_max_matches);
+
+         const uint match_ref_ofs = atomic_exchange_add(&blk.m_next_match_ref, num_matches_to_write);
+
+         memcpy(&blk.m_matches[match_ref_ofs],
+                pMatches + (num_matches - num_matches_to_write),
+                sizeof(pMatches[0]) * num_matches_to_write);
+
+         // FIXME: This is going to really hurt on platforms requiring export barriers.
+         LZHAM_MEMORY_EXPORT_BARRIER
+
+         set_match_ref(blk, lookahead_pos, match_ref_ofs);
+      }
+      else
+      {
+         set_match_ref(blk, lookahead_pos, cMatchRefNone);
+      }
+   }
+
+   void search_accelerator::set_match_ref(match_block& blk, uint lookahead_pos, atomic32_t match_ref)
+   {
+      if (atomic_exchange32(&blk.m_match_refs[static_cast<uint>(lookahead_pos - blk.m_lookahead_pos)], match_ref) == cMatchRefWaitedOn)
+         blk.m_match_ref_set.notify_all();
+   }
+
    void search_accelerator::find_all_matches_callback(uint64 data, void* pData_ptr)
    {
       scoped_perf_section find_all_matches_timer("find_all_matches_callback");
 
-      pData_ptr;
+      match_block &blk = *static_cast<match_block*>(pData_ptr);
       const uint thread_index = (uint)data;
 
       dict_match temp_matches[cMatchAccelMaxSupportedProbes * 2];
 
-      uint fill_lookahead_pos = m_fill_lookahead_pos;
-      uint fill_dict_size = m_fill_dict_size;
-      uint fill_lookahead_size = m_fill_lookahead_size;
+      uint fill_lookahead_pos = blk.m_lookahead_pos;
+      uint fill_dict_size = blk.m_dict_size;
+      uint fill_lookahead_size = blk.m_lookahead_size;
 
       uint c0 = 0, c1 = 0;
       if (fill_lookahead_size >= 2)
@@ -131,7 +369,16 @@ namespace lzham
          c0 = c1;
          c1 = c2;
 
-         LZHAM_ASSERT(!m_hash_thread_index.size() || (m_hash_thread_index[h] != UINT8_MAX));
+         // Start loading the next string's root while this one is inserted. It's only a hint, so it doesn't matter if
+         // the root changes first, or belongs to another thread.
+         if (fill_lookahead_size >= 4)
+         {
+            const uint next_root = m_hash[hash3_to_16(c0, c1, pDict[insert_pos + 3])] & m_max_dict_size_mask;
+            LZHAM_PREFETCH(&m_nodes[next_root]);
+            LZHAM_PREFETCH(&pDict[next_root]);
+         }
+
+         LZHAM_ASSERT(!m_hash_thread_index.size() || (m_hash_thread_index[h] != UINT16_MAX));
 
          // Only process those strings that this worker thread was assigned to - this allows us to manipulate multiple trees in parallel with no worries about synchronization.
          if (m_hash_thread_index.size() && (m_hash_thread_index[h] != thread_index))
@@ -155,7 +402,7 @@ namespace lzham
 
          const uint8* pIns = &pDict[insert_pos];
 
-         uint n = m_max_probes;
+         uint n = blk.m_max_probes;
          for ( ; ; )
          {
             uint delta_pos = fill_lookahead_pos - cur_pos;
@@ -169,38 +416,18 @@ namespace lzham
             uint pos = cur_pos & m_max_dict_size_mask;
             node *pNode = &m_nodes[pos];
 
+            // Which child comes next depends on the compare, so start loading both of them (and their strings) now. The
+            // links read here don't change until this node is passed.
+            const uint left_pos = pNode->m_left & m_max_dict_size_mask;
+            const uint right_pos = pNode->m_right & m_max_dict_size_mask;
+            LZHAM_PREFETCH(&m_nodes[left_pos]);
+            LZHAM_PREFETCH(&m_nodes[right_pos]);
+            LZHAM_PREFETCH(&pDict[left_pos]);
+            LZHAM_PREFETCH(&pDict[right_pos]);
+
             // Unfortunately, the initial compare match_len must be 2 because of the way we truncate matches at the end of each block.
-            uint match_len = 0;
             const uint8* pComp = &pDict[pos];
-
-#if LZHAM_PLATFORM_X360
-            for ( ; match_len < max_match_len; match_len++)
-               if (pComp[match_len] != pIns[match_len])
-                  break;
-#else
-            // Compare a qword at a time for a bit more efficiency.
-            const uint64* pComp_end = reinterpret_cast<const uint64*>(pComp + max_match_len - 7);
-            const uint64* pComp_cur = reinterpret_cast<const uint64*>(pComp);
-            const uint64* pIns_cur = reinterpret_cast<const uint64*>(pIns);
-            while (pComp_cur < pComp_end)
-            {
-               if (*pComp_cur != *pIns_cur)
-                  break;
-               pComp_cur++;
-               pIns_cur++;
-            }
-            uint alt_match_len = static_cast<uint>(reinterpret_cast<const uint8*>(pComp_cur) - reinterpret_cast<const uint8*>(pComp));
-            for ( ; alt_match_len < max_match_len; alt_match_len++)
-               if (pComp[alt_match_len] != pIns[alt_match_len])
-                  break;
-#ifdef LZVERIFY
-            for ( ; match_len < max_match_len; match_len++)
-               if (pComp[match_len] != pIns[match_len])
-                  break;
-            LZHAM_VERIFY(alt_match_len == match_len);
-#endif
-            match_len = alt_match_len;
-#endif
+            const uint match_len = compute_match_len(pComp, pIns, max_match_len);
 
             if (match_len > best_match_len)
             {
@@ -225,40 +452,7 @@ namespace lzham
             }
             else if ((best_match_len > 2) && (best_match_len == match_len))
             {
-               uint bestMatchDist = pDstMatch[-1].m_dist;
-               uint compMatchDist = delta_pos;
-
-               uint bestMatchSlot, bestMatchSlotOfs;
-               m_pLZBase->compute_lzx_position_slot(bestMatchDist, bestMatchSlot, bestMatchSlotOfs);
-
-               uint compMatchSlot, compMatchOfs;
-               m_pLZBase->compute_lzx_position_slot(compMatchDist, compMatchSlot, compMatchOfs);
-
-               // If both matches uses the same match slot, choose the one with the offset containing the lowest nibble as these bits separately entropy coded.
-               // This could choose a match which is further away in the absolute sense, but closer in a coding sense.
-               if ( (compMatchSlot < bestMatchSlot) ||
-                  ((compMatchSlot >= 8) && (compMatchSlot == bestMatchSlot) && ((compMatchOfs & 15) < (bestMatchSlotOfs & 15))) )
-               {
-                  LZHAM_ASSERT((pDstMatch[-1].m_len + (uint)CLZBase::cMinMatchLen) == best_match_len);
-                  pDstMatch[-1].m_dist = delta_pos;
-               }
-               else if ((match_len < max_match_len) && (compMatchSlot <= bestMatchSlot))
-               {
-                  // Choose the match which has lowest hamming distance in the mismatch byte for a tiny win on binary files.
-                  // TODO: This competes against the prev. optimization.
-                  uint desired_mismatch_byte = pIns[match_len];
-
-                  uint cur_mismatch_byte = pDict[(insert_pos - bestMatchDist + match_len) & m_max_dict_size_mask];
-                  uint cur_mismatch_dist = g_hamming_dist[cur_mismatch_byte ^ desired_mismatch_byte];
-
-                  uint new_mismatch_byte = pComp[match_len];
-                  uint new_mismatch_dist = g_hamming_dist[new_mismatch_byte ^ desired_mismatch_byte];
-                  if (new_mismatch_dist < cur_mismatch_dist)
-                  {
-                     LZHAM_ASSERT((pDstMatch[-1].m_len + (uint)CLZBase::cMinMatchLen) == best_match_len);
-                     pDstMatch[-1].m_dist = delta_pos;
-                  }
-               }
+               update_equal_len_match(pDstMatch[-1], insert_pos, pIns, pComp, delta_pos, match_len, max_match_len);
             }
 
             uint new_pos;
@@ -279,30 +473,139 @@ namespace lzham
             cur_pos = new_pos;
          }
 
-         const uint num_matches = (uint)(pDstMatch - temp_matches);
+         publish_matches(blk, fill_lookahead_pos, temp_matches, (uint)(pDstMatch - temp_matches));
 
-         if (num_matches)
-         {
-            pDstMatch[-1].m_dist |= 0x80000000;
+         fill_lookahead_pos++;
+         fill_lookahead_size--;
+         fill_dict_size++;
+      }
 
-            const uint num_matches_to_write = LZHAM_MIN(num_matches, m_max_matches);
+      while (fill_lookahead_size)
+      {
+         uint insert_pos = fill_lookahead_pos & m_max_dict_size_mask;
+         m_nodes[insert_pos].m_left = 0;
+         m_nodes[insert_pos].m_right = 0;
 
-            const uint match_ref_ofs = atomic_exchange_add(&m_next_match_ref, num_matches_to_write);
+         set_match_ref(blk, fill_lookahead_pos, cMatchRefNone);
 
-            memcpy(&m_matches[match_ref_ofs],
-                   temp_matches + (num_matches - num_matches_to_write),
-                   sizeof(temp_matches[0]) * num_matches_to_write);
+         fill_lookahead_pos++;
+         fill_lookahead_size--;
+         fill_dict_size++;
+      }
+      
+      atomic_increment32(&blk.m_num_completed_helper_threads);
+   }
+
+   void search_accelerator::find_all_matches_hash_chain_callback(uint64 data, void* pData_ptr)
+   {
+      scoped_perf_section find_all_matches_timer("find_all_matches_hash_chain_callback");
+
+      match_block &blk = *static_cast<match_block*>(pData_ptr);
+      const uint thread_index = (uint)data;
+
+      dict_match temp_matches[cMatchAccelMaxSupportedProbes * 2];
 
-            // FIXME: This is going to really hurt on platforms requiring export barriers.
-            LZHAM_MEMORY_EXPORT_BARRIER
+      uint fill_lookahead_pos = blk.m_lookahead_pos;
+      uint fill_dict_size = blk.m_dict_size;
+      uint fill_lookahead_size = blk.m_lookahead_size;
 
-            atomic_exchange32((atomic32_t*)&m_match_refs[static_cast<uint>(fill_lookahead_pos - m_fill_lookahead_pos)], match_ref_ofs);
+      const uint8* pDict = m_dict.get_ptr();
+      uint* pChain = m_chain.get_ptr();
+
+      while (fill_lookahead_size >= 3)
+      {
+         const uint insert_pos = fill_lookahead_pos & m_max_dict_size_mask;
+         const uint8* pIns = &pDict[insert_pos];
+
+         const uint h = hash3_to_16(pIns[0], pIns[1], pIns[2]);
+
+         // Chains are partitioned between the helper threads by their 3 byte hash, like the trees.
+         if ((m_hash_thread_index.size()) && (m_hash_thread_index[h] != thread_index))
+         {
+            fill_lookahead_pos++;
+            fill_lookahead_size--;
+            fill_dict_size++;
+            continue;
          }
-         else
+
+         // The last 3 bytes of a block aren't followed by a 4th yet, so they're chained as if it was 0.
+         const uint c3 = (fill_lookahead_size >= 4) ? pIns[3] : 0;
+         const uint chain_h = hash4_from_hash3(h, pIns[0], pIns[1], pIns[2], c3, m_chain_hash_shift);
+
+         const uint hash3_pos = m_hash[h];
+         m_hash[h] = fill_lookahead_pos;
+
+         const uint chain_head = m_chain_hash[chain_h];
+         m_chain_hash[chain_h] = fill_lookahead_pos;
+         pChain[insert_pos] = chain_head;
+
+         const uint max_match_len = LZHAM_MIN(CLZBase::cMaxMatchLen, fill_lookahead_size);
+         uint best_match_len = 2;
+
+         dict_match* pDstMatch = temp_matches;
+
+         // The most recent position with the same 3 byte hash is tried first. If it isn't also the chain's head, its 4th byte
+         // differs, so it's only worth a probe if it's close enough for a len3 match to pay off. Then the chain is walked from
+         // the most recent position, until it leaves the dictionary or max_probes are used up.
+         uint comp_pos = hash3_pos;
+         if ((hash3_pos != chain_head) && ((fill_lookahead_pos - hash3_pos) >= cHashChainMaxLen3MatchDist))
+            comp_pos = fill_lookahead_pos;
+         for (uint probe = 0; ; probe++)
          {
-            atomic_exchange32((atomic32_t*)&m_match_refs[static_cast<uint>(fill_lookahead_pos - m_fill_lookahead_pos)], -2);
+            const uint delta_pos = fill_lookahead_pos - comp_pos;
+            const bool in_dict = (delta_pos) && (delta_pos < fill_dict_size);
+
+            if (in_dict)
+            {
+               const uint8* pComp = &pDict[comp_pos & m_max_dict_size_mask];
+               const uint match_len = compute_match_len(pComp, pIns, max_match_len);
+
+               if (match_len > best_match_len)
+               {
+                  pDstMatch->m_len = static_cast<uint8>(match_len - CLZBase::cMinMatchLen);
+                  pDstMatch->m_dist = delta_pos;
+                  pDstMatch++;
+
+                  best_match_len = match_len;
+
+                  if (match_len == max_match_len)
+                     break;
+               }
+               else if (m_all_matches)
+               {
+                  if (match_len > 2)
+                  {
+                     pDstMatch->m_len = static_cast<uint8>(match_len - CLZBase::cMinMatchLen);
+                     pDstMatch->m_dist = delta_pos;
+                     pDstMatch++;
+                  }
+               }
+               else if ((best_match_len > 2) && (best_match_len == match_len))
+               {
+                  update_equal_len_match(pDstMatch[-1], insert_pos, pIns, pComp, delta_pos, match_len, max_match_len);
+               }
+            }
+            else if (probe)
+            {
+               // Everything further down the chain is even older.
+               break;
+            }
+
+            if ((probe + 1) >= blk.m_max_probes)
+               break;
+
+            if (probe)
+               comp_pos = pChain[comp_pos & m_max_dict_size_mask];
+            else if (chain_head != hash3_pos)
+               comp_pos = chain_head;
+            else if (in_dict)
+               comp_pos = pChain[chain_head & m_max_dict_size_mask];
+            else
+               break;
          }
 
+         publish_matches(blk, fill_lookahead_pos, temp_matches, (uint)(pDstMatch - temp_matches));
+
          fill_lookahead_pos++;
          fill_lookahead_size--;
          fill_dict_size++;
@@ -310,62 +613,143 @@ namespace lzham
 
       while (fill_lookahead_size)
       {
-         uint insert_pos = fill_lookahead_pos & m_max_dict_size_mask;
-         m_nodes[insert_pos].m_left = 0;
-         m_nodes[insert_pos].m_right = 0;
-
-         atomic_exchange32((atomic32_t*)&m_match_refs[static_cast<uint>(fill_lookahead_pos - m_fill_lookahead_pos)], -2);
+         set_match_ref(blk, fill_lookahead_pos, cMatchRefNone);
 
          fill_lookahead_pos++;
          fill_lookahead_size--;
          fill_dict_size++;
       }
-      
-      atomic_increment32(&m_num_completed_helper_threads);
+
+      atomic_increment32(&blk.m_num_completed_helper_threads);
    }
 
-   bool search_accelerator::find_len2_matches()
+   bool search_accelerator::find_len2_matches(match_block& blk)
    {
-      enum { cDigramHashSize = 4096 };
-
       if (!m_digram_hash.size())
       {
          if (!m_digram_hash.try_resize(cDigramHashSize))
             return false;
       }
 
-      if (m_digram_next.size() < m_lookahead_size)
+      if (blk.m_digram_next.size() < blk.m_lookahead_size)
       {
-         if (!m_digram_next.try_resize(m_lookahead_size))
+         if (!blk.m_digram_next.try_resize(blk.m_lookahead_size))
             return false;
       }
 
-      uint lookahead_dict_pos = m_lookahead_pos & m_max_dict_size_mask;
+      uint lookahead_dict_pos = blk.m_lookahead_pos & m_max_dict_size_mask;
 
-      for (int lookahead_ofs = 0; lookahead_ofs < ((int)m_lookahead_size - 1); ++lookahead_ofs, ++lookahead_dict_pos)
+      for (int lookahead_ofs = 0; lookahead_ofs < ((int)blk.m_lookahead_size - 1); ++lookahead_ofs, ++lookahead_dict_pos)
       {
          uint c0 = m_dict[lookahead_dict_pos];
          uint c1 = m_dict[lookahead_dict_pos + 1];
 
          uint h = hash2_to_12(c0, c1) & (cDigramHashSize - 1);
 
-         m_digram_next[lookahead_ofs] = m_digram_hash[h];
-         m_digram_hash[h] = m_lookahead_pos + lookahead_ofs;
+         blk.m_digram_next[lookahead_ofs] = m_digram_hash[h];
+         m_digram_hash[h] = blk.m_lookahead_pos + lookahead_ofs;
       }
 
-      m_digram_next[m_lookahead_size - 1] = 0;
+      blk.m_digram_next[blk.m_lookahead_size - 1] = 0;
+
+      return true;
+   }
+
+   // Runs before the block's helper tasks are queued. Hashes the block's bytes, and for each anchor that hits an earlier
+   // one, verifies and extends the repeat (within the block) and marks the positions it covers with its distance.
+   bool search_accelerator::find_long_distance_matches(match_block& blk)
+   {
+      if (!blk.m_ldm_dists.try_resize_no_construct(blk.m_lookahead_size))
+         return false;
+
+      memset(blk.m_ldm_dists.get_ptr(), 0, blk.m_ldm_dists.size_in_bytes());
+
+      const uint8* pDict = m_dict.get_ptr();
+      const uint8* pBlock = &pDict[blk.m_lookahead_pos & m_max_dict_size_mask];
+      uint* pDists = blk.m_ldm_dists.get_ptr();
+
+      uint64 h = m_ldm_rolling_hash;
+      uint num_hashed_bytes = m_ldm_num_hashed_bytes;
+
+      // Offset of the end of the last repeat found. Anchors inside it aren't looked up.
+      uint covered_end_ofs = 0;
+
+      for (uint ofs = 0; ofs < blk.m_lookahead_size; ofs++)
+      {
+         // Each byte is shifted one bit further up per step, so the top bits depend on the last 64 bytes.
+         h = (h << 1) + m_ldm_gear[pBlock[ofs]];
+
+         if (num_hashed_bytes < cLDMWindowSize)
+         {
+            if (++num_hashed_bytes < cLDMWindowSize)
+               continue;
+         }
+
+         if (h >> (64 - cLDMAnchorBits))
+            continue;
+
+         // The anchor is the first byte of the window, which may be in the previous block.
+         const uint anchor_pos = blk.m_lookahead_pos + ofs + 1 - cLDMWindowSize;
+
+         uint& entry = m_ldm_hash[static_cast<uint>(h >> m_ldm_hash_shift)];
+         const uint prev_anchor_pos = entry;
+         entry = anchor_pos;
+
+         if (ofs < covered_end_ofs)
+            continue;
+
+         const uint start_ofs = LZHAM_MAX(covered_end_ofs, ((ofs + 1) > cLDMWindowSize) ? (ofs + 1 - cLDMWindowSize) : 0);
+
+         const uint dist = anchor_pos - prev_anchor_pos;
+         if ((!dist) || (dist > (blk.m_dict_size + start_ofs)))
+            continue;
+
+         uint end_ofs = start_ofs;
+         for ( ; ; )
+         {
+            const uint max_match_len = LZHAM_MIN(CLZBase::cMaxMatchLen, blk.m_lookahead_size - end_ofs);
+            if (!max_match_len)
+               break;
+
+            const uint match_len = compute_match_len(&pDict[(blk.m_lookahead_pos + end_ofs - dist) & m_max_dict_size_mask], &pBlock[end_ofs], max_match_len);
+            end_ofs += match_len;
+
+            if (match_len < max_match_len)
+               break;
+         }
+
+         // Extend backwards, but not into the last repeat or to positions which can't reach back dist bytes yet.
+         const uint min_ofs = LZHAM_MAX(covered_end_ofs, (dist > blk.m_dict_size) ? (dist - blk.m_dict_size) : 0);
+
+         uint begin_ofs = start_ofs;
+         while ((begin_ofs > min_ofs) && (pBlock[begin_ofs - 1] == pDict[(blk.m_lookahead_pos + begin_ofs - 1 - dist) & m_max_dict_size_mask]))
+            begin_ofs--;
+
+         if ((end_ofs - begin_ofs) < cLDMMinMatchLen)
+            continue;
+
+         for (uint i = begin_ofs; i < end_ofs; i++)
+            pDists[i] = dist;
+
+         covered_end_ofs = end_ofs;
+      }
+
+      m_ldm_rolling_hash = h;
+      m_ldm_num_hashed_bytes = num_hashed_bytes;
 
       return true;
    }
 
    uint search_accelerator::get_len2_match(uint lookahead_ofs)
    {
-      if ((m_fill_lookahead_size - lookahead_ofs) < 2)
+      const match_block &blk = m_match_blocks[m_cur_match_block];
+
+      if ((blk.m_lookahead_size - lookahead_ofs) < 2)
          return 0;
 
       uint cur_pos = m_lookahead_pos + lookahead_ofs;
 
-      uint next_match_pos = m_digram_next[cur_pos - m_fill_lookahead_pos];
+      uint next_match_pos = blk.m_digram_next[cur_pos - blk.m_lookahead_pos];
 
       uint match_dist = cur_pos - next_match_pos;
 
@@ -381,122 +765,285 @@ namespace lzham
       return 0;
    }
 
-   bool search_accelerator::find_all_matches(uint num_bytes)
+   static void age_positions(uint* pPos, uint num_pos, uint cur_pos, uint max_dist)
+   {
+      const uint oldest_pos = cur_pos - max_dist;
+      for (uint i = 0; i < num_pos; i++)
+         if ((cur_pos - pPos[i]) >= max_dist)
+            pPos[i] = oldest_pos;
+   }
+
+   // Positions are stored in 32 bits, so a hash head that goes unused for 4GB would wrap around and appear recent again.
+   // Every so often any head which has fallen out of the dictionary is moved up to just outside it, which keeps all
+   // stored distances well below 2^31. Tree nodes and chain links are only reachable through heads, so they don't need this.
+   void search_accelerator::age_hash_heads(uint lookahead_pos)
+   {
+      age_positions(m_hash.get_ptr(), m_hash.size(), lookahead_pos, m_max_dict_size);
+
+      if (m_chain_hash.size())
+         age_positions(m_chain_hash.get_ptr(), m_chain_hash.size(), lookahead_pos, m_max_dict_size);
+
+      if (m_digram_hash.size())
+         age_positions(m_digram_hash.get_ptr(), m_digram_hash.size(), lookahead_pos, m_max_dict_size);
+
+      if (m_ldm_hash.size())
+         age_positions(m_ldm_hash.get_ptr(), m_ldm_hash.size(), lookahead_pos, m_max_dict_size);
+   }
+
+   // All the strings with the same 3 byte hash are inserted by the same helper thread, so the hashes are dealt out to
+   // balance the number of strings each thread inserts. Round robin leaves some threads with much more work on skewed data
+   // (runs, repeated records), where a few hashes cover much of the block. So the hashes are counted first, then the most
+   // common ones are given to the least loaded thread in order of decreasing count. The rest are each too small to matter
+   // much, so they're dealt out round robin.
+   bool search_accelerator::assign_hashes_to_threads(uint lookahead_pos, uint num_bytes)
    {
-      if (!m_matches.try_resize_no_construct(m_max_probes * num_bytes))
+      if (!m_hash_thread_index.try_resize_no_construct(0x10000))
          return false;
 
-      if (!m_match_refs.try_resize_no_construct(num_bytes))
+      memset(m_hash_thread_index.get_ptr(), 0xFF, m_hash_thread_index.size_in_bytes());
+
+      if (num_bytes < 3)
+         return true;
+
+      const uint num_strings = num_bytes - 2;
+
+      if ((!m_hash_counts.try_resize_no_construct(0x10000)) || (!m_block_hashes.try_resize_no_construct(num_strings)))
          return false;
 
-      memset(m_match_refs.get_ptr(), 0xFF, m_match_refs.size_in_bytes());
+      memset(m_hash_counts.get_ptr(), 0, m_hash_counts.size_in_bytes());
 
-      m_fill_lookahead_pos = m_lookahead_pos;
-      m_fill_lookahead_size = num_bytes;
-      m_fill_dict_size = m_cur_dict_size;
+      const uint8* pDict = &m_dict[lookahead_pos & m_max_dict_size_mask];
+      uint* pCounts = m_hash_counts.get_ptr();
+      uint16* pBlock_hashes = m_block_hashes.get_ptr();
+      uint num_block_hashes = 0;
 
-      m_next_match_ref = 0;
+      uint c0 = pDict[0];
+      uint c1 = pDict[1];
+      for (uint i = 0; i < num_strings; i++)
+      {
+         const uint c2 = pDict[i + 2];
+         const uint h = hash3_to_16(c0, c1, c2);
+         c0 = c1;
+         c1 = c2;
 
-      if (!m_pTask_pool)
+         if (!pCounts[h]++)
+            pBlock_hashes[num_block_hashes++] = static_cast<uint16>(h);
+      }
+
+      // A hash is common if it covers at least 1/8th of one thread's fair share. At most num_strings / common_count hashes
+      // can, which is about 8 per thread (or half the strings of a tiny block), so there's room for all of them.
+      const uint common_count = LZHAM_MAX(2U, num_strings / (m_max_helper_threads * 8));
+      if (!m_common_hashes.try_resize_no_construct(num_strings / common_count))
+         return false;
+
+      uint16* pCommon_hashes = m_common_hashes.get_ptr();
+      uint num_common_hashes = 0;
+
+      for (uint i = 0; i < num_block_hashes; i++)
       {
-         find_all_matches_callback(0, NULL);
-         
-         m_num_completed_helper_threads = 0;
+         const uint h = pBlock_hashes[i];
+         const uint count = pCounts[h];
+         if (count < common_count)
+            continue;
+
+         // Insertion sort, most common first.
+         uint j = num_common_hashes++;
+         for ( ; (j) && (pCounts[pCommon_hashes[j - 1]] < count); j--)
+            pCommon_hashes[j] = pCommon_hashes[j - 1];
+         pCommon_hashes[j] = static_cast<uint16>(h);
       }
-      else
+
+      // The threads are kept in a min heap by load, so the least loaded one is always at the root.
+      uint thread_load[LZHAM_MAX_HELPER_THREADS];
+      uint thread_heap[LZHAM_MAX_HELPER_THREADS];
+      for (uint t = 0; t < m_max_helper_threads; t++)
       {
-         if (!m_hash_thread_index.try_resize_no_construct(0x10000))
-            return false;
+         thread_load[t] = 0;
+         thread_heap[t] = t;
+      }
 
-         memset(m_hash_thread_index.get_ptr(), 0xFF, m_hash_thread_index.size_in_bytes());
+      for (uint i = 0; i < num_common_hashes; i++)
+      {
+         const uint h = pCommon_hashes[i];
+         const uint best_thread = thread_heap[0];
 
-         uint next_thread_index = 0;
-         const uint8* pDict = &m_dict[m_lookahead_pos & m_max_dict_size_mask];
-         uint num_unique_digrams = 0;
+         m_hash_thread_index[h] = static_cast<uint16>(best_thread);
+         thread_load[best_thread] += pCounts[h];
 
-         if (num_bytes >= 3)
+         // Sift the root down to its new place.
+         uint parent = 0;
+         for ( ; ; )
          {
-            uint c0 = pDict[0];
-            uint c1 = pDict[1];
+            uint child = parent * 2 + 1;
+            if (child >= m_max_helper_threads)
+               break;
+            if ((child + 1 < m_max_helper_threads) && (thread_load[thread_heap[child + 1]] < thread_load[thread_heap[child]]))
+               child++;
+            if (thread_load[thread_heap[child]] >= thread_load[best_thread])
+               break;
 
-            const int limit = ((int)num_bytes - 2);
-            for (int i = 0; i < limit; i++)
-            {
-               uint c2 = pDict[2];
-               uint t = hash3_to_16(c0, c1, c2);
-               c0 = c1;
-               c1 = c2;
+            thread_heap[parent] = thread_heap[child];
+            parent = child;
+         }
+         thread_heap[parent] = best_thread;
+      }
 
-               pDict++;
+      // The round robin starts at whichever thread the common hashes left least loaded.
+      uint next_thread = thread_heap[0];
+      for (uint i = 0; i < num_block_hashes; i++)
+      {
+         const uint h = pBlock_hashes[i];
+         if (m_hash_thread_index[h] != UINT16_MAX)
+            continue;
 
-               if (m_hash_thread_index[t] == UINT8_MAX)
-               {
-                  num_unique_digrams++;
+         m_hash_thread_index[h] = static_cast<uint16>(next_thread);
+         if (++next_thread == m_max_helper_threads)
+            next_thread = 0;
+      }
 
-                  m_hash_thread_index[t] = static_cast<uint8>(next_thread_index);
-                  if (++next_thread_index == m_max_helper_threads)
-                        next_thread_index = 0;
-               }
-            }
-         }
+      return true;
+   }
+
+   bool search_accelerator::find_all_matches(match_block& blk, uint lookahead_pos, uint num_bytes, uint dict_size)
+   {
+      // No helper threads are running here, so the heads can be safely aged whenever a 1GB boundary is crossed.
+      if ((lookahead_pos ^ (lookahead_pos + num_bytes)) & ~(cHashHeadAgingInterval - 1))
+         age_hash_heads(lookahead_pos);
+
+      if (!blk.m_matches.try_resize_no_construct(m_max_probes * num_bytes))
+         return false;
+
+      if (!blk.m_match_refs.try_resize_no_construct(num_bytes))
+         return false;
+
+      memset(blk.m_match_refs.get_ptr(), 0xFF, blk.m_match_refs.size_in_bytes());
+
+      blk.m_lookahead_pos = lookahead_pos;
+      blk.m_lookahead_size = num_bytes;
+      blk.m_dict_size = dict_size;
+      blk.m_max_probes = m_max_probes;
+      blk.m_max_matches = m_max_matches;
+
+      blk.m_next_match_ref = 0;
+
+      if ((m_ldm_hash.size()) && (!find_long_distance_matches(blk)))
+         return false;
+
+      if (!m_pTask_pool)
+      {
+         if (m_match_finder == cMatchFinderHashChain)
+            find_all_matches_hash_chain_callback(0, &blk);
+         else
+            find_all_matches_callback(0, &blk);
          
-         m_num_completed_helper_threads = 0;
+         blk.m_num_completed_helper_threads = 0;
+      }
+      else
+      {
+         if (!assign_hashes_to_threads(lookahead_pos, num_bytes))
+            return false;
+
+         blk.m_num_completed_helper_threads = 0;
 
-         if (!m_pTask_pool->queue_multiple_object_tasks(this, &search_accelerator::find_all_matches_callback, 0, m_max_helper_threads))
+         const object_task<search_accelerator>::object_method_ptr pCallback = (m_match_finder == cMatchFinderHashChain) ? &search_accelerator::find_all_matches_hash_chain_callback : &search_accelerator::find_all_matches_callback;
+
+         if (!m_pTask_pool->queue_multiple_object_tasks(this, pCallback, 0, m_max_helper_threads, &blk, &m_task_group))
             return false;
       }
 
-      return find_len2_matches();
+      return find_len2_matches(blk);
    }
 
-   bool search_accelerator::add_bytes_begin(uint num_bytes, const uint8* pBytes)
+   void search_accelerator::copy_bytes(uint add_pos, uint num_bytes, const uint8* pBytes)
    {
-      LZHAM_ASSERT(num_bytes <= m_max_dict_size);
-      LZHAM_ASSERT(!m_lookahead_size);
-
-      uint add_pos = m_lookahead_pos & m_max_dict_size_mask;
       LZHAM_ASSERT((add_pos + num_bytes) <= m_max_dict_size);
 
       memcpy(&m_dict[add_pos], pBytes, num_bytes);
 
       if (add_pos < CLZBase::cMaxMatchLen)
          memcpy(&m_dict[m_max_dict_size], &m_dict[0], CLZBase::cMaxMatchLen);
+   }
+
+   bool search_accelerator::add_bytes_begin(uint num_bytes, const uint8* pBytes)
+   {
+      LZHAM_ASSERT(num_bytes <= m_max_dict_size);
+      LZHAM_ASSERT(!m_lookahead_size);
+
+      if (m_prefetch_size)
+      {
+         // The bytes are already in the dictionary, and their matches have been (or are being) found.
+         LZHAM_ASSERT((num_bytes == m_prefetch_size) && (pBytes == get_prefetch_ptr()));
+
+         m_cur_match_block ^= 1;
+         LZHAM_ASSERT(m_match_blocks[m_cur_match_block].m_lookahead_pos == m_lookahead_pos);
+
+         m_lookahead_size = num_bytes;
+         m_cur_dict_size = m_match_blocks[m_cur_match_block].m_dict_size;
+         m_prefetch_size = 0;
+
+         return true;
+      }
+
+      copy_bytes(m_lookahead_pos & m_max_dict_size_mask, num_bytes, pBytes);
 
       m_lookahead_size = num_bytes;
 
-      uint max_possible_dict_size = m_max_dict_size - num_bytes;
+      uint max_possible_dict_size = m_max_dict_size - num_bytes - m_max_prefetch_bytes;
       m_cur_dict_size = LZHAM_MIN(m_cur_dict_size, max_possible_dict_size);
 
-      m_next_match_ref = 0;
-
-      return find_all_matches(num_bytes);
+      return find_all_matches(m_match_blocks[m_cur_match_block], m_lookahead_pos, num_bytes, m_cur_dict_size);
    }
 
    void search_accelerator::add_bytes_end()
    {
-      if (m_pTask_pool)
+      // If the next block has been prefetched, this block's tasks were joined first, and the next block's are left running.
+      if ((m_pTask_pool) && (!m_prefetch_size))
       {
-         m_pTask_pool->join();
+         m_pTask_pool->join(&m_task_group);
       }
 
-      LZHAM_ASSERT((uint)m_next_match_ref <= m_matches.size());
+      LZHAM_ASSERT((uint)m_match_blocks[m_cur_match_block].m_next_match_ref <= m_match_blocks[m_cur_match_block].m_matches.size());
+   }
+
+   bool search_accelerator::prefetch_bytes(uint num_bytes, const uint8* pBytes)
+   {
+      LZHAM_ASSERT((num_bytes) && (num_bytes <= m_max_prefetch_bytes));
+      LZHAM_ASSERT(!m_prefetch_size);
+
+      // Each tree is updated by one helper at a time, so the current block's tasks must finish first.
+      m_pTask_pool->join(&m_task_group);
+
+      const uint lookahead_pos = m_lookahead_pos + m_lookahead_size;
+
+      copy_bytes(lookahead_pos & m_max_dict_size_mask, num_bytes, pBytes);
+
+      // The dictionary the block starts with ends up the same size as it would have been if it was added after the
+      // current block.
+      uint max_possible_dict_size = m_max_dict_size - num_bytes - m_max_prefetch_bytes;
+      uint dict_size = LZHAM_MIN(m_cur_dict_size + m_lookahead_size, max_possible_dict_size);
+
+      m_prefetch_size = num_bytes;
+
+      return find_all_matches(m_match_blocks[m_cur_match_block ^ 1], lookahead_pos, num_bytes, dict_size);
    }
 
    dict_match* search_accelerator::find_matches(uint lookahead_ofs, bool spin)
    {
       LZHAM_ASSERT(lookahead_ofs < m_lookahead_size);
 
-      const uint match_ref_ofs = static_cast<uint>(m_lookahead_pos - m_fill_lookahead_pos + lookahead_ofs);
+      match_block &blk = m_match_blocks[m_cur_match_block];
+
+      const uint match_ref_ofs = static_cast<uint>(m_lookahead_pos - blk.m_lookahead_pos + lookahead_ofs);
 
       int match_ref;
       uint spin_count = 0;
 
       for ( ; ; )
       {
-         match_ref = m_match_refs[match_ref_ofs];
-         if (match_ref == -2)
+         match_ref = blk.m_match_refs[match_ref_ofs];
+         if (match_ref == cMatchRefNone)
             return NULL;
-         else if (match_ref != -1)
+         else if (match_ref >= 0)
             break;
 
          spin_count++;
@@ -518,13 +1065,49 @@ namespace lzham
          {
             spin_count = cMaxSpinCount;
 
-            lzham_sleep(1);
+            // If the pool is shared, the helper task this position is waiting on may still be queued behind other
+            // compressors' work, so run it here instead of sleeping.
+            if ((m_pTask_pool) && (m_pTask_pool->try_execute_task(&m_task_group)))
+               continue;
+
+            // Otherwise the helper is running, and is woken up by the helper when it gets to this position. The position
+            // is marked first, so the helper knows someone is waiting on it.
+            const atomic32_t key = blk.m_match_ref_set.prepare_wait();
+
+            const atomic32_t cur_match_ref = atomic_compare_exchange32(&blk.m_match_refs[match_ref_ofs], cMatchRefWaitedOn, cMatchRefPending);
+            if ((cur_match_ref == cMatchRefPending) || (cur_match_ref == cMatchRefWaitedOn))
+               blk.m_match_ref_set.wait(key);
+            else
+               blk.m_match_ref_set.cancel_wait();
          }
       }
 
       LZHAM_MEMORY_IMPORT_BARRIER
 
-      return &m_matches[match_ref];
+      return &blk.m_matches[match_ref];
+   }
+
+   bool search_accelerator::add_seed_bytes(uint num_bytes, const uint8* pBytes, uint max_bytes_per_add)
+   {
+      LZHAM_ASSERT((!m_cur_dict_size) && (!m_lookahead_size) && (!m_lookahead_pos) && (!m_prefetch_size));
+      LZHAM_ASSERT((num_bytes <= m_max_dict_size) && (max_bytes_per_add));
+
+      m_lookahead_pos = m_max_dict_size - num_bytes;
+
+      while (num_bytes)
+      {
+         const uint n = LZHAM_MIN(num_bytes, max_bytes_per_add);
+
+         if (!add_bytes_begin(n, pBytes))
+            return false;
+         add_bytes_end();
+         advance_bytes(n);
+
+         pBytes += n;
+         num_bytes -= n;
+      }
+
+      return true;
    }
 
    void search_accelerator::advance_bytes(uint num_bytes)
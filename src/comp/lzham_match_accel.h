@@ -3,6 +3,7 @@
 #pragma once
 #include "lzham_lzbase.h"
 #include "lzham_threading.h"
+#include "lzham_match_len.h"
 
 namespace lzham
 {
@@ -34,11 +35,61 @@ namespace lzham
    {
    public:
       search_accelerator();
+      ~search_accelerator();
+
+      enum match_finder_type
+      {
+         // Binary trees (one per 3 byte hash bucket), rebalanced at every inserted position. Finds the most matches per probe.
+         cMatchFinderBinaryTree,
+
+         // HC4 style: the most recent position with the same 3 byte hash, followed by a chain of previous positions with the
+         // same 4 byte hash, max_probes positions in all. Cheaper per byte, and half the memory, but finds fewer long matches
+         // per probe.
+         cMatchFinderHashChain
+      };
+
+      enum 
+      { 
+         cMinHashChainBits = 16, 
+         cMaxHashChainBits = 24,
+
+         // The hash chain finder only looks for len3 matches closer than this.
+         cHashChainMaxLen3MatchDist = 8192
+      };
+
+      enum
+      {
+         // Long distance matching: a rolling hash of the last cLDMWindowSize bytes picks about one position in
+         // 2^cLDMAnchorBits as an anchor. Anchors are looked up in a table of earlier anchors, and repeats of at least
+         // cLDMMinMatchLen bytes found this way are offered to the parser along with the finder's matches.
+         cLDMWindowSize = 64,
+         cLDMAnchorBits = 6,
+         cLDMMinMatchLen = 32,
+         cMinLDMHashBits = 12,
+         cMaxLDMHashBits = 22
+      };
 
       // If all_matches is true, the match finder returns all found matches with no filtering.
       // Otherwise, the finder will tend to return lists of matches with mostly unique lengths.
       // For each length, it will discard matches with worse distances (in the coding sense).
-      bool init(CLZBase* pLZBase, task_pool* pPool, uint max_helper_threads, uint max_dict_size, uint max_matches, bool all_matches, uint max_probes);
+      // max_prefetch_bytes is the largest block prefetch_bytes() will be given (0 disables prefetching). That much of the
+      // dictionary is kept free, so a prefetched block never overwrites anything the current block can match against.
+      // hash_chain_bits is the log2 of the number of 4 byte hash chain heads, and is only used by cMatchFinderHashChain.
+      // alloc_policy (lzham_alloc_policy_flags) and numa_node control how the dictionary and tree/chain tables are allocated.
+      // ldm_hash_bits is the log2 of the number of long distance match anchors to remember (0 disables long distance matching).
+      bool init(CLZBase* pLZBase, task_pool* pPool, uint max_helper_threads, uint max_dict_size, uint max_matches, bool all_matches, uint max_probes, uint max_prefetch_bytes, match_finder_type finder = cMatchFinderBinaryTree, uint hash_chain_bits = cMinHashChainBits, uint alloc_policy = 0, uint numa_node = 0, uint ldm_hash_bits = 0);
+
+      // Empties the dictionary and hash tables without releasing any memory.
+      void reset();
+
+      // Changes the search effort for the blocks added (or prefetched) from now on. max_probes may not exceed the value
+      // given to init().
+      void set_max_probes(uint max_matches, uint max_probes);
+
+      // Heap bytes used by an accelerator initialized with these parameters, when given at most max_add_bytes at a time.
+      static uint64 get_memory_requirements(uint max_dict_size, uint max_add_bytes, uint max_probes, uint max_helper_threads, bool prefetching, match_finder_type finder = cMatchFinderBinaryTree, uint hash_chain_bits = cMinHashChainBits, uint ldm_hash_bits = 0);
+
+      inline match_finder_type get_match_finder() const { return m_match_finder; }
       
       inline uint get_max_dict_size() const { return m_max_dict_size; }
       inline uint get_max_dict_size_mask() const { return m_max_dict_size_mask; }
@@ -57,13 +108,28 @@ namespace lzham
             
       uint get_max_add_bytes() const;
       bool add_bytes_begin(uint num_bytes, const uint8* pBytes);
-      inline atomic32_t get_num_completed_helper_threads() const { return m_num_completed_helper_threads; }
+      inline atomic32_t get_num_completed_helper_threads() const { return m_match_blocks[m_cur_match_block].m_num_completed_helper_threads; }
+      inline bool is_find_complete() const { return get_num_completed_helper_threads() == static_cast<atomic32_t>(m_max_helper_threads); }
       void add_bytes_end();
+
+      // Adds the block following the current one to the dictionary and starts finding its matches on the helper threads
+      // (after waiting for the current block's), so they're ready by the time it's passed to add_bytes_begin().
+      bool prefetch_bytes(uint num_bytes, const uint8* pBytes);
+      inline uint get_max_prefetch_bytes() const { return m_max_prefetch_bytes; }
+      inline uint get_prefetch_size() const { return m_prefetch_size; }
+      inline const uint8* get_prefetch_ptr() const { return &m_dict[(m_lookahead_pos + m_lookahead_size) & m_max_dict_size_mask]; }
+
+      // Where the next block will be added.
+      inline uint get_add_pos() const { return m_lookahead_pos + m_lookahead_size + m_prefetch_size; }
       
       uint get_len2_match(uint lookahead_ofs);
       dict_match* find_matches(uint lookahead_ofs, bool spin = true);
             
       void advance_bytes(uint num_bytes);
+
+      // Fills an empty window with up to max_dict_size bytes of history, max_bytes_per_add at a time. The history ends
+      // exactly at the end of the circular buffer, so the blocks added afterwards are aligned as if it weren't there.
+      bool add_seed_bytes(uint num_bytes, const uint8* pBytes, uint max_bytes_per_add);
       
       LZHAM_FORCE_INLINE uint get_match_len(uint lookahead_ofs, int dist, uint max_match_len) const
       {
@@ -79,17 +145,13 @@ namespace lzham
          const uint8* pComp = &m_dict[comp_pos];
          const uint8* pLookahead = &m_dict[lookahead_pos];
          
-         uint match_len;
-         for (match_len = 0; match_len < max_match_len; match_len++)
-            if (pComp[match_len] != pLookahead[match_len])
-               break;
-
-         return match_len;
+         return compute_match_len(pComp, pLookahead, max_match_len);
       }
                   
    public:
       CLZBase* m_pLZBase;
       task_pool* m_pTask_pool;
+      task_pool::task_group m_task_group;
       uint m_max_helper_threads;
    
       uint m_max_dict_size;
@@ -100,36 +162,98 @@ namespace lzham
                   
       uint m_cur_dict_size;
             
-      lzham::vector<uint8> m_dict;
+      large_array<uint8> m_dict;
       
+      match_finder_type m_match_finder;
+
+      // The tree roots, or with the hash chain finder, the most recent position with each 3 byte hash.
       enum { cHashSize = 65536 };
       lzham::vector<uint> m_hash;
-      lzham::vector<node> m_nodes;
 
-      lzham::vector<dict_match> m_matches;
-      lzham::vector<atomic32_t> m_match_refs;
-      
-      lzham::vector<uint8> m_hash_thread_index;
+      // How often heads which have fallen out of the dictionary are aged, see age_hash_heads().
+      enum { cHashHeadAgingInterval = 0x40000000 };
+      large_array<node> m_nodes;
+
+      // Hash chain finder only. The low 16 bits of a chain's 4 byte hash are the 3 byte hash, so every position on a chain
+      // belongs to the same helper thread.
+      large_array<uint> m_chain_hash;
+      large_array<uint> m_chain;
+      uint m_chain_hash_shift;
+
+      // A position's match ref is the index of its first match in m_matches, or one of these.
+      enum { cMatchRefPending = -1, cMatchRefNone = -2, cMatchRefWaitedOn = -3 };
+
+      // The matches found for one block. The current block's are in m_match_blocks[m_cur_match_block], and the prefetched
+      // block's (if any) in the other.
+      struct match_block
+      {
+         match_block() : m_lookahead_pos(0), m_lookahead_size(0), m_dict_size(0), m_max_probes(0), m_max_matches(0), m_next_match_ref(0), m_num_completed_helper_threads(0) { }
+
+         lzham::vector<dict_match> m_matches;
+         lzham::vector<atomic32_t> m_match_refs;
+         lzham::vector<uint> m_digram_next;
+
+         // The distance of the long distance match covering each position, or 0. Empty if long distance matching is off.
+         lzham::vector<uint> m_ldm_dists;
+
+         uint m_lookahead_pos;
+         uint m_lookahead_size;
+         uint m_dict_size;
+
+         uint m_max_probes;
+         uint m_max_matches;
+
+         volatile atomic32_t m_next_match_ref;
+
+         volatile atomic32_t m_num_completed_helper_threads;
+
+         // Notified when a position someone sleeps on (see find_matches()) gets its matches.
+         event_count m_match_ref_set;
+      };
+
+      match_block m_match_blocks[2];
+      uint m_cur_match_block;
+
+      // The helper thread that inserts each 3 byte hash's strings, or UINT16_MAX if none of the block's strings have it.
+      lzham::vector<uint16> m_hash_thread_index;
+
+      // Scratch for assign_hashes_to_threads(): the number of strings with each hash in the block, the block's distinct
+      // hashes in order of first appearance, and its common hashes in order of decreasing count.
+      lzham::vector<uint> m_hash_counts;
+      lzham::vector<uint16> m_block_hashes;
+      lzham::vector<uint16> m_common_hashes;
       
+      enum { cDigramHashSize = 4096 };
       lzham::vector<uint> m_digram_hash;
-      lzham::vector<uint> m_digram_next;
-                                          
-      uint m_fill_lookahead_pos;
-      uint m_fill_lookahead_size;
-      uint m_fill_dict_size;
+
+      // Long distance matching only: the most recent anchor with each rolling hash, and the rolling hash of the bytes
+      // before the next block.
+      large_array<uint> m_ldm_hash;
+      uint m_ldm_hash_shift;
+      uint64 m_ldm_gear[256];
+      uint64 m_ldm_rolling_hash;
+      uint m_ldm_num_hashed_bytes;
       
       uint m_max_probes;
       uint m_max_matches;
+      uint m_init_max_probes;
       
       bool m_all_matches;
-                  
-      volatile atomic32_t m_next_match_ref;
-      
-      volatile atomic32_t m_num_completed_helper_threads;
+
+      uint m_max_prefetch_bytes;
+      uint m_prefetch_size;
                   
       void find_all_matches_callback(uint64 data, void* pData_ptr);
-      bool find_all_matches(uint num_bytes);
-      bool find_len2_matches();
+      void find_all_matches_hash_chain_callback(uint64 data, void* pData_ptr);
+      void update_equal_len_match(dict_match &best_match, uint insert_pos, const uint8* pIns, const uint8* pComp, uint delta_pos, uint match_len, uint max_match_len) const;
+      void set_match_ref(match_block& blk, uint lookahead_pos, atomic32_t match_ref);
+      void publish_matches(match_block& blk, uint lookahead_pos, dict_match* pMatches, uint num_matches);
+      void age_hash_heads(uint lookahead_pos);
+      bool assign_hashes_to_threads(uint lookahead_pos, uint num_bytes);
+      bool find_all_matches(match_block& blk, uint lookahead_pos, uint num_bytes, uint dict_size);
+      bool find_len2_matches(match_block& blk);
+      bool find_long_distance_matches(match_block& blk);
+      void copy_bytes(uint add_pos, uint num_bytes, const uint8* pBytes);
    };
 
 } // namespace lzham
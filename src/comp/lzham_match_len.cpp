@@ -0,0 +1,187 @@
+// File: lzham_match_len.cpp
+// See Copyright Notice and license at the end of include/lzham.h
+#include "lzham_core.h"
+#include "lzham_match_len.h"
+
+#if LZHAM_MATCH_LEN_WORD_COMPARES && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+   #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+      #define LZHAM_MATCH_LEN_SSE2 1
+      #include <emmintrin.h>
+   #endif
+
+   // AVX2 code is compiled for a specific function, and only called if the CPU (and OS) supports it.
+   #if defined(__GNUC__) && (defined(__clang__) || (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+      #define LZHAM_MATCH_LEN_AVX2 1
+      #define LZHAM_AVX2_TARGET __attribute__((target("avx2")))
+      #include <immintrin.h>
+   #elif defined(_MSC_VER) && (_MSC_VER >= 1800)
+      #define LZHAM_MATCH_LEN_AVX2 1
+      #define LZHAM_AVX2_TARGET
+      #include <immintrin.h>
+      #include <intrin.h>
+   #endif
+#endif
+
+#ifndef LZHAM_MATCH_LEN_SSE2
+   #define LZHAM_MATCH_LEN_SSE2 0
+#endif
+
+#ifndef LZHAM_MATCH_LEN_AVX2
+   #define LZHAM_MATCH_LEN_AVX2 0
+#endif
+
+namespace lzham
+{
+   static uint match_len_bytes(const uint8* pA, const uint8* pB, uint max_len)
+   {
+      uint len;
+      for (len = 0; len < max_len; len++)
+         if (pA[len] != pB[len])
+            break;
+      return len;
+   }
+
+#if LZHAM_MATCH_LEN_WORD_COMPARES
+   // Continues a compare from len, 8 bytes at a time, and finishes the last (max_len - len) % 8 bytes one at a time.
+   static LZHAM_FORCE_INLINE uint match_len_words_from(const uint8* pA, const uint8* pB, uint len, uint max_len)
+   {
+      for ( ; (len + 8) <= max_len; len += 8)
+      {
+         const uint64 x = *reinterpret_cast<const uint64*>(pA + len) ^ *reinterpret_cast<const uint64*>(pB + len);
+         if (x)
+            return len + (math::count_trailing_zero_bits64(x) >> 3);
+      }
+
+      for ( ; len < max_len; len++)
+         if (pA[len] != pB[len])
+            break;
+      return len;
+   }
+
+   static uint match_len_words(const uint8* pA, const uint8* pB, uint max_len)
+   {
+      return match_len_words_from(pA, pB, 0, max_len);
+   }
+#endif
+
+#if LZHAM_MATCH_LEN_SSE2
+   static uint match_len_sse2(const uint8* pA, const uint8* pB, uint max_len)
+   {
+      if (max_len < 16)
+         return match_len_words_from(pA, pB, 0, max_len);
+
+      // The last stride is moved back to end at max_len. The bytes it overlaps are already known to match.
+      const uint last_ofs = max_len - 16;
+      for (uint ofs = 0; ; ofs += 16)
+      {
+         ofs = LZHAM_MIN(ofs, last_ofs);
+
+         const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pA + ofs));
+         const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pB + ofs));
+
+         // One bit per byte that differs.
+         const uint mask = static_cast<uint>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) ^ 0xFFFFU;
+         if (mask)
+            return ofs + math::count_trailing_zero_bits64(mask);
+
+         if (ofs == last_ofs)
+            return max_len;
+      }
+   }
+#endif
+
+#if LZHAM_MATCH_LEN_AVX2
+   LZHAM_AVX2_TARGET static uint match_len_avx2(const uint8* pA, const uint8* pB, uint max_len)
+   {
+      if (max_len < 32)
+         return match_len_words_from(pA, pB, 0, max_len);
+
+      const uint last_ofs = max_len - 32;
+      for (uint ofs = 0; ; ofs += 32)
+      {
+         ofs = LZHAM_MIN(ofs, last_ofs);
+
+         const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pA + ofs));
+         const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pB + ofs));
+
+         const uint32 mask = ~static_cast<uint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+         if (mask)
+            return ofs + math::count_trailing_zero_bits64(mask);
+
+         if (ofs == last_ofs)
+            return max_len;
+      }
+   }
+
+   static bool cpu_has_avx2()
+   {
+#if defined(__GNUC__)
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") != 0;
+#else
+      int info[4];
+      __cpuid(info, 0);
+      if (info[0] < 7)
+         return false;
+
+      // The OS must also save the YMM registers on context switches.
+      __cpuid(info, 1);
+      const int cOSXSAVE = 1 << 27, cAVX = 1 << 28;
+      if ((info[2] & (cOSXSAVE | cAVX)) != (cOSXSAVE | cAVX))
+         return false;
+      if ((_xgetbv(0) & 6) != 6)
+         return false;
+
+      __cpuidex(info, 7, 0);
+      return (info[1] & (1 << 5)) != 0;
+#endif
+   }
+#endif
+
+   static const match_len_kernel_func_ptr g_match_len_kernels[cMatchLenKernelTotal] =
+   {
+      match_len_bytes,
+#if LZHAM_MATCH_LEN_WORD_COMPARES
+      match_len_words,
+#else
+      NULL,
+#endif
+#if LZHAM_MATCH_LEN_SSE2
+      match_len_sse2,
+#else
+      NULL,
+#endif
+#if LZHAM_MATCH_LEN_AVX2
+      match_len_avx2,
+#else
+      NULL,
+#endif
+   };
+
+   static bool is_match_len_kernel_supported(match_len_kernel_type type)
+   {
+      if (!g_match_len_kernels[type])
+         return false;
+
+#if LZHAM_MATCH_LEN_AVX2
+      if (type == cMatchLenKernelAVX2)
+         return cpu_has_avx2();
+#endif
+
+      return true;
+   }
+
+   match_len_kernel_type get_best_match_len_kernel()
+   {
+      for (uint i = cMatchLenKernelTotal - 1; i > cMatchLenKernelBytes; i--)
+         if (is_match_len_kernel_supported(static_cast<match_len_kernel_type>(i)))
+            return static_cast<match_len_kernel_type>(i);
+
+      return cMatchLenKernelBytes;
+   }
+
+   // Picked once by a static initializer, before any compressor (or its helper threads) can run, so the pointer is only
+   // ever read while compressing.
+   match_len_kernel_func_ptr g_pMatch_len_kernel = g_match_len_kernels[get_best_match_len_kernel()];
+
+} // namespace lzham
@@ -0,0 +1,55 @@
+// File: lzham_match_len.h
+// See Copyright Notice and license at the end of include/lzham.h
+#pragma once
+
+#if LZHAM_USE_UNALIGNED_INT_LOADS && LZHAM_LITTLE_ENDIAN_CPU
+   #define LZHAM_MATCH_LEN_WORD_COMPARES 1
+#else
+   #define LZHAM_MATCH_LEN_WORD_COMPARES 0
+#endif
+
+namespace lzham
+{
+   // Returns the number of leading bytes (up to max_len) the two strings have in common. Never reads past max_len bytes.
+   typedef uint (*match_len_kernel_func_ptr)(const uint8* pA, const uint8* pB, uint max_len);
+
+   enum match_len_kernel_type
+   {
+      cMatchLenKernelBytes,      // a byte at a time
+      cMatchLenKernelWords,      // 8 bytes at a time, the first mismatch is found with a trailing zero count
+      cMatchLenKernelSSE2,       // 16 bytes at a time
+      cMatchLenKernelAVX2,       // 32 bytes at a time
+
+      cMatchLenKernelTotal
+   };
+
+   // The fastest kernel this CPU supports, picked when the library is loaded.
+   extern match_len_kernel_func_ptr g_pMatch_len_kernel;
+
+   // Returns the fastest kernel supported by this build and CPU.
+   match_len_kernel_type get_best_match_len_kernel();
+
+   // Returns the number of leading bytes (up to max_len) the two strings have in common. All the compressor's match
+   // length computations go through here.
+   LZHAM_FORCE_INLINE uint compute_match_len(const uint8* pA, const uint8* pB, uint max_len)
+   {
+#if LZHAM_MATCH_LEN_WORD_COMPARES
+      // Most compares end within the first 8 bytes, so those are checked here before calling the kernel.
+      if (max_len >= 8)
+      {
+         const uint64 x = *reinterpret_cast<const uint64*>(pA) ^ *reinterpret_cast<const uint64*>(pB);
+         if (x)
+            return math::count_trailing_zero_bits64(x) >> 3;
+
+         return 8 + (*g_pMatch_len_kernel)(pA + 8, pB + 8, max_len - 8);
+      }
+#endif
+
+      uint len;
+      for (len = 0; len < max_len; len++)
+         if (pA[len] != pB[len])
+            break;
+      return len;
+   }
+
+} // namespace lzham
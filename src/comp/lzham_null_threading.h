@@ -30,6 +30,19 @@ namespace lzham
       }      
    };   
 
+   class event_count
+   {
+      LZHAM_NO_COPY_OR_ASSIGNMENT_OP(event_count);
+
+   public:
+      inline event_count() { }
+
+      inline atomic32_t prepare_wait() { return 0; }
+      inline void cancel_wait() { }
+      inline void wait(atomic32_t key) { key; }
+      inline void notify_all() { }
+   };
+
    class task_pool
    {
    public:
@@ -37,12 +50,18 @@ namespace lzham
       inline task_pool(uint num_threads) { num_threads; }
       inline ~task_pool() { }
 
-      inline bool init(uint num_threads) { num_threads; return true; }
+      inline bool init(uint num_threads, const uint* pCPUs = NULL, uint num_cpus = 0) { num_threads, pCPUs, num_cpus; return true; }
       inline void deinit();
 
       inline uint get_num_threads() const { return 0; }
       inline uint get_num_outstanding_tasks() const { return 0; }
 
+      class task_group
+      {
+      public:
+         inline uint get_num_outstanding_tasks() const { return 0; }
+      };
+
       // C-style task callback
       typedef void (*task_callback_func)(uint64 data, void* pData_ptr);
       inline bool queue_task(task_callback_func pFunc, uint64 data = 0, void* pData_ptr = NULL)
@@ -72,8 +91,9 @@ namespace lzham
       }
 
       template<typename S, typename T>
-      inline bool queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks, void* pData_ptr = NULL)
+      inline bool queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks, void* pData_ptr = NULL, task_group *pGroup = NULL)
       {
+         pGroup;
          for (uint i = 0; i < num_tasks; i++)
          {
             (pObject->*pObject_method)(first_data + i, pData_ptr);
@@ -81,7 +101,8 @@ namespace lzham
          return true;
       }
 
-      void join() { }
+      void join(task_group *pGroup = NULL) { pGroup; }
+      bool try_execute_task(task_group *pGroup) { pGroup; return false; }
    };
    
    inline void lzham_sleep(unsigned int milliseconds)
@@ -89,4 +110,10 @@ namespace lzham
       milliseconds;
    }
 
+   inline uint lzham_get_cache_sharing_cpus(uint* pCPUs, uint max_cpus)
+   {
+      pCPUs, max_cpus;
+      return 0;
+   }
+
 } // namespace lzham
@@ -27,6 +27,10 @@
 #include <process.h>
 #endif
 
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 #if LZHAM_USE_PTHREADS_API
 
 #ifdef WIN32
@@ -35,22 +39,156 @@
 
 namespace lzham
 {
+   task_pool::task_group::task_group() :
+      m_num_outstanding_tasks(0),
+      m_cur_array(0),
+      m_top(0),
+      m_bottom(0),
+      m_pPool(NULL),
+      m_pool_slot(0)
+   {
+      utils::zero_object(m_arrays);
+   }
+
+   task_pool::task_group::~task_group()
+   {
+      LZHAM_ASSERT(!m_num_outstanding_tasks);
+
+      if (m_pPool)
+         m_pPool->remove_group(this);
+
+      for (uint i = 0; i < cMaxArrays; i++)
+         lzham_free(m_arrays[i]);
+   }
+
+   // Owner only. Fails if the deque can't grow enough, in which case nothing is pushed.
+   bool task_pool::task_group::push(const task& tsk, uint64 first_data, uint num_tasks)
+   {
+      const atomic32_t bottom = m_bottom;
+      const atomic32_t top = m_top;
+      const uint num_queued = static_cast<uint>(bottom - top) + num_tasks;
+
+      uint cur_array = m_cur_array;
+      if ((!m_arrays[cur_array]) || (num_queued > (1U << (cMinArraySizeLog2 + cur_array))))
+      {
+         uint new_array = m_arrays[cur_array] ? (cur_array + 1) : cur_array;
+         while ((new_array < cMaxArrays) && (num_queued > (1U << (cMinArraySizeLog2 + new_array))))
+            new_array++;
+         if (new_array >= cMaxArrays)
+            return false;
+
+         const uint new_size = 1U << (cMinArraySizeLog2 + new_array);
+         task* pNew_tasks = static_cast<task*>(lzham_malloc(sizeof(task) * new_size));
+         if (!pNew_tasks)
+            return false;
+
+         // Thieves may keep reading the old array, which is left as it is.
+         if (m_arrays[cur_array])
+         {
+            const uint old_mask = (1U << (cMinArraySizeLog2 + cur_array)) - 1;
+            for (atomic32_t i = top; i != bottom; i++)
+               pNew_tasks[i & (new_size - 1)] = m_arrays[cur_array][i & old_mask];
+         }
+
+         m_arrays[new_array] = pNew_tasks;
+         atomic_exchange32(&m_cur_array, new_array);
+         cur_array = new_array;
+      }
+
+      task* pTasks = m_arrays[cur_array];
+      const uint mask = (1U << (cMinArraySizeLog2 + cur_array)) - 1;
+      for (uint i = 0; i < num_tasks; i++)
+      {
+         task& dst = pTasks[(bottom + i) & mask];
+         dst = tsk;
+         dst.m_data = first_data + i;
+      }
+
+      // Publishes the new tasks.
+      atomic_exchange32(&m_bottom, bottom + num_tasks);
+
+      return true;
+   }
+
+   // Owner only. Takes the most recently pushed task.
+   bool task_pool::task_group::pop(task& tsk)
+   {
+      const atomic32_t bottom = m_bottom - 1;
+
+      // The new bottom must be visible before top is read, or a thief could take the same task.
+      atomic_exchange32(&m_bottom, bottom);
+
+      const atomic32_t top = m_top;
+      if ((bottom - top) < 0)
+      {
+         atomic_exchange32(&m_bottom, top);
+         return false;
+      }
+
+      const uint cur_array = m_cur_array;
+      tsk = m_arrays[cur_array][bottom & ((1U << (cMinArraySizeLog2 + cur_array)) - 1)];
+
+      if (bottom != top)
+         return true;
+
+      // The last task: thieves may be after it too.
+      const bool succeeded = (atomic_compare_exchange32(&m_top, top + 1, top) == top);
+
+      atomic_exchange32(&m_bottom, top + 1);
+
+      return succeeded;
+   }
+
+   // Any thread. Takes the least recently pushed task.
+   task_pool::task_group::steal_status task_pool::task_group::steal(task& tsk)
+   {
+      const atomic32_t top = m_top;
+      LZHAM_MEMORY_IMPORT_BARRIER
+      const atomic32_t bottom = m_bottom;
+      LZHAM_MEMORY_IMPORT_BARRIER
+
+      if ((bottom - top) <= 0)
+         return cStealEmpty;
+
+      const uint cur_array = m_cur_array;
+      tsk = m_arrays[cur_array][top & ((1U << (cMinArraySizeLog2 + cur_array)) - 1)];
+
+      if (atomic_compare_exchange32(&m_top, top + 1, top) != top)
+         return cStealLostRace;
+
+      return cStealSucceeded;
+   }
+
    task_pool::task_pool() :
+      m_num_group_slots(0),
       m_num_threads(0),
       m_tasks_available(0, 32767),
       m_num_outstanding_tasks(0),
       m_exit_flag(false)
    {
-      utils::zero_object(m_threads);
+      for (uint i = 0; i < cMaxTaskGroups; i++)
+      {
+         m_groups[i] = NULL;
+         m_group_thieves[i] = 0;
+      }
+
+      add_group(&m_default_group);
    }
 
    task_pool::task_pool(uint num_threads) :
+      m_num_group_slots(0),
       m_num_threads(0),
       m_tasks_available(0, 32767),
       m_num_outstanding_tasks(0),
       m_exit_flag(false)
    {
-      utils::zero_object(m_threads);
+      for (uint i = 0; i < cMaxTaskGroups; i++)
+      {
+         m_groups[i] = NULL;
+         m_group_thieves[i] = 0;
+      }
+
+      add_group(&m_default_group);
 
       bool status = init(num_threads);
       LZHAM_VERIFY(status);
@@ -59,21 +197,59 @@ namespace lzham
    task_pool::~task_pool()
    {
       deinit();
+
+      remove_group(&m_default_group);
    }
 
-   bool task_pool::init(uint num_threads)
+   bool task_pool::init(uint num_threads, const uint* pCPUs, uint num_cpus)
    {
-      LZHAM_ASSERT(num_threads <= cMaxThreads);
-      num_threads = math::minimum<uint>(num_threads, cMaxThreads);
-
       deinit();
 
+      if (!m_threads.try_resize(num_threads))
+         return false;
+
+      pthread_attr_t attr;
+      pthread_attr_t* pAttr = NULL;
+#if defined(__linux__)
+      // The threads are started on the CPUs they may run on, rather than moved there after they've started touching memory.
+      if ((num_cpus) && (!pthread_attr_init(&attr)))
+      {
+         cpu_set_t cpus;
+         CPU_ZERO(&cpus);
+         for (uint i = 0; i < num_cpus; i++)
+         {
+            if (pCPUs[i] < CPU_SETSIZE)
+               CPU_SET(pCPUs[i], &cpus);
+         }
+
+         cpu_set_t allowed_cpus;
+         if (!sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus))
+            CPU_AND(&cpus, &cpus, &allowed_cpus);
+
+         if ((CPU_COUNT(&cpus)) && (!pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus)))
+            pAttr = &attr;
+         else
+            pthread_attr_destroy(&attr);
+      }
+#else
+      pCPUs, num_cpus;
+#endif
+
       bool succeeded = true;
 
       m_num_threads = 0;
       while (m_num_threads < num_threads)
       {
-         int status = pthread_create(&m_threads[m_num_threads], NULL, thread_func, this);
+         int status = pthread_create(&m_threads[m_num_threads], pAttr, thread_func, this);
+
+         // The OS may refuse the CPUs (if they're offline, say), in which case the threads run anywhere.
+         if ((status) && (pAttr))
+         {
+            pthread_attr_destroy(pAttr);
+            pAttr = NULL;
+            status = pthread_create(&m_threads[m_num_threads], NULL, thread_func, this);
+         }
+
          if (status)
          {
             succeeded = false;
@@ -83,6 +259,9 @@ namespace lzham
          m_num_threads++;
       }
 
+      if (pAttr)
+         pthread_attr_destroy(pAttr);
+
       if (!succeeded)
       {
          deinit();
@@ -106,33 +285,85 @@ namespace lzham
             pthread_join(m_threads[i], NULL);
 
          m_num_threads = 0;
+         m_threads.clear();
 
          atomic_exchange32(&m_exit_flag, false);
       }
 
-      m_task_stack.clear();
+      // Detach the clients' groups. They're added again if they queue more tasks after the pool is reinitialized.
+      m_groups_lock.lock();
+      for (uint i = 0; i < cMaxTaskGroups; i++)
+      {
+         task_group* pGroup = m_groups[i];
+         if ((pGroup) && (pGroup != &m_default_group))
+         {
+            pGroup->m_pPool = NULL;
+            m_groups[i] = NULL;
+         }
+      }
+      m_groups_lock.unlock();
+
       m_num_outstanding_tasks = 0;
    }
 
+   bool task_pool::add_group(task_group* pGroup)
+   {
+      if (pGroup->m_pPool)
+         pGroup->m_pPool->remove_group(pGroup);
+
+      bool result = false;
+
+      m_groups_lock.lock();
+      for (uint i = 0; i < cMaxTaskGroups; i++)
+      {
+         if (!m_groups[i])
+         {
+            pGroup->m_pPool = this;
+            pGroup->m_pool_slot = i;
+
+            m_groups[i] = pGroup;
+            if (i >= static_cast<uint>(m_num_group_slots))
+               atomic_exchange32(&m_num_group_slots, i + 1);
+
+            result = true;
+            break;
+         }
+      }
+      m_groups_lock.unlock();
+
+      return result;
+   }
+
+   void task_pool::remove_group(task_group* pGroup)
+   {
+      LZHAM_ASSERT(pGroup->m_pPool == this);
+
+      const uint slot = pGroup->m_pool_slot;
+
+      m_groups_lock.lock();
+      m_groups[slot] = NULL;
+      m_groups_lock.unlock();
+
+      pGroup->m_pPool = NULL;
+
+      // Thieves that found the group before it was removed may still be using it.
+      while (atomic_add32(&m_group_thieves[slot], 0))
+         lzham_yield_processor();
+   }
+
    bool task_pool::queue_task(task_callback_func pFunc, uint64 data, void* pData_ptr)
    {
       LZHAM_ASSERT(m_num_threads);
       LZHAM_ASSERT(pFunc);
 
       task tsk;
+      tsk.m_pInvoke = invoke_callback;
       tsk.m_callback = pFunc;
-      tsk.m_data = data;
+      tsk.m_data = 0;
       tsk.m_pData_ptr = pData_ptr;
-      tsk.m_flags = 0;
-
-      if (!m_task_stack.try_push(tsk))
-         return false;
-
-      atomic_increment32(&m_num_outstanding_tasks);
-
-      m_tasks_available.release(1);
+      tsk.m_pGroup = NULL;
 
-      return true;
+      return queue_tasks(tsk, data, 1);
    }
 
    // It's the object's responsibility to delete pObj within the execute_task() method, if needed!
@@ -142,47 +373,160 @@ namespace lzham
       LZHAM_ASSERT(pObj);
 
       task tsk;
+      tsk.m_pInvoke = invoke_executable_task;
       tsk.m_pObj = pObj;
-      tsk.m_data = data;
+      tsk.m_data = 0;
       tsk.m_pData_ptr = pData_ptr;
-      tsk.m_flags = cTaskFlagObject;
+      tsk.m_pGroup = NULL;
 
-      if (!m_task_stack.try_push(tsk))
-         return false;
+      return queue_tasks(tsk, data, 1);
+   }
+
+   bool task_pool::queue_tasks(const task& tsk, uint64 first_data, uint num_tasks)
+   {
+      task_group* pGroup = tsk.m_pGroup ? tsk.m_pGroup : &m_default_group;
+
+      atomic_add32(&m_num_outstanding_tasks, num_tasks);
+      atomic_add32(&pGroup->m_num_outstanding_tasks, num_tasks);
 
-      atomic_increment32(&m_num_outstanding_tasks);
+      bool pushed;
+      if (pGroup == &m_default_group)
+      {
+         m_default_group_lock.lock();
+         pushed = pGroup->push(tsk, first_data, num_tasks);
+         m_default_group_lock.unlock();
+      }
+      else
+      {
+         pushed = ((pGroup->m_pPool == this) || (add_group(pGroup))) && (pGroup->push(tsk, first_data, num_tasks));
+      }
 
-      m_tasks_available.release(1);
+      if (pushed)
+      {
+         // Awake threads keep stealing until they run out of tasks, so more wakeups than threads aren't needed.
+         m_tasks_available.release(LZHAM_MIN(num_tasks, m_num_threads));
+      }
+      else
+      {
+         for (uint i = 0; i < num_tasks; i++)
+         {
+            task t(tsk);
+            t.m_data = first_data + i;
+            t.m_pGroup = pGroup;
+            process_task(t);
+         }
+      }
 
       return true;
    }
 
+   void task_pool::invoke_callback(const task& tsk)
+   {
+      tsk.m_callback(tsk.m_data, tsk.m_pData_ptr);
+   }
+
+   void task_pool::invoke_executable_task(const task& tsk)
+   {
+      tsk.m_pObj->execute_task(tsk.m_data, tsk.m_pData_ptr);
+   }
+
    void task_pool::process_task(task& tsk)
    {
-      if (tsk.m_flags & cTaskFlagObject)
-         tsk.m_pObj->execute_task(tsk.m_data, tsk.m_pData_ptr);
-      else
-         tsk.m_callback(tsk.m_data, tsk.m_pData_ptr);
+      tsk.m_pInvoke(tsk);
+
+      task_group* pGroup = tsk.m_pGroup ? tsk.m_pGroup : &m_default_group;
+      const bool group_done = !atomic_decrement32(&pGroup->m_num_outstanding_tasks);
+
+      const bool all_done = !atomic_decrement32(&m_num_outstanding_tasks);
 
-      atomic_decrement32(&m_num_outstanding_tasks);
+      if ((group_done) || (all_done))
+         m_tasks_done.notify_all();
    }
 
-   void task_pool::join()
+   // Steals a task from any group. Only gives up once every group has been seen empty.
+   bool task_pool::try_steal_task(task& tsk)
    {
-      task tsk;
-      while (atomic_add32(&m_num_outstanding_tasks, 0) > 0)
+      for ( ; ; )
       {
-         if (m_task_stack.pop(tsk))
+         bool lost_race = false;
+
+         const uint num_slots = static_cast<uint>(m_num_group_slots);
+         for (uint i = 0; i < num_slots; i++)
          {
-            process_task(tsk);
+            atomic_increment32(&m_group_thieves[i]);
+
+            task_group* pGroup = m_groups[i];
+            const task_group::steal_status status = pGroup ? pGroup->steal(tsk) : task_group::cStealEmpty;
+
+            atomic_decrement32(&m_group_thieves[i]);
+
+            if (status == task_group::cStealSucceeded)
+               return true;
+            else if (status == task_group::cStealLostRace)
+               lost_race = true;
          }
-         else
+
+         if (!lost_race)
+            return false;
+      }
+   }
+
+   void task_pool::join(task_group *pGroup)
+   {
+      task tsk;
+
+      if (!pGroup)
+      {
+         while (atomic_add32(&m_num_outstanding_tasks, 0) > 0)
          {
-            lzham_sleep(1);
+            if (try_steal_task(tsk))
+               process_task(tsk);
+            else
+               wait_for_tasks(&m_num_outstanding_tasks);
          }
+         return;
+      }
+
+      while (atomic_add32(&pGroup->m_num_outstanding_tasks, 0) > 0)
+      {
+         if ((pGroup->m_pPool == this) && (pGroup->pop(tsk)))
+            process_task(tsk);
+         else
+            wait_for_tasks(&pGroup->m_num_outstanding_tasks);
       }
    }
 
+   // Nothing is left to steal, so the remaining tasks are running on other threads. Sleeps until one of them finishes
+   // the last (or the tasks have already finished).
+   void task_pool::wait_for_tasks(volatile atomic32_t* pNum_outstanding_tasks)
+   {
+      const atomic32_t key = m_tasks_done.prepare_wait();
+
+      if (atomic_add32(pNum_outstanding_tasks, 0) > 0)
+         m_tasks_done.wait(key);
+      else
+         m_tasks_done.cancel_wait();
+   }
+
+   bool task_pool::try_execute_task(task_group *pGroup)
+   {
+      if (pGroup->m_pPool != this)
+         return false;
+
+      task tsk;
+      for ( ; ; )
+      {
+         const task_group::steal_status status = pGroup->steal(tsk);
+         if (status == task_group::cStealSucceeded)
+            break;
+         else if (status == task_group::cStealEmpty)
+            return false;
+      }
+
+      process_task(tsk);
+      return true;
+   }
+
    void * task_pool::thread_func(void *pContext)
    {
       task_pool* pPool = static_cast<task_pool*>(pContext);
@@ -196,15 +540,78 @@ namespace lzham
          if (pPool->m_exit_flag)
             break;
 
-         if (pPool->m_task_stack.pop(tsk))
-         {
+         while (pPool->try_steal_task(tsk))
             pPool->process_task(tsk);
-         }
       }
 
       return NULL;
    }
 
+#if defined(__linux__)
+   // Adds the CPUs of a sysfs CPU list ("0-3,8-11") to pCPUs.
+   static uint read_cpu_list(const char* pFilename, uint* pCPUs, uint max_cpus)
+   {
+      FILE* pFile = fopen(pFilename, "r");
+      if (!pFile)
+         return 0;
+
+      char buf[4096];
+      const bool read = (fgets(buf, sizeof(buf), pFile) != NULL);
+      fclose(pFile);
+      if (!read)
+         return 0;
+
+      uint num_cpus = 0;
+      const char* p = buf;
+      while ((*p >= '0') && (*p <= '9'))
+      {
+         char* pEnd;
+         const uint first = static_cast<uint>(strtoul(p, &pEnd, 10));
+         uint last = first;
+         p = pEnd;
+         if (*p == '-')
+         {
+            last = static_cast<uint>(strtoul(p + 1, &pEnd, 10));
+            p = pEnd;
+         }
+
+         for (uint cpu = first; (cpu <= last) && (num_cpus < max_cpus); cpu++)
+            pCPUs[num_cpus++] = cpu;
+
+         if (*p == ',')
+            p++;
+      }
+
+      return num_cpus;
+   }
+
+   uint lzham_get_cache_sharing_cpus(uint* pCPUs, uint max_cpus)
+   {
+      const int cur_cpu = sched_getcpu();
+      if (cur_cpu < 0)
+         return 0;
+
+      // The cache with the highest index is the last level one.
+      char filename[256];
+      for (int index = 15; index >= 0; index--)
+      {
+         sprintf(filename, "/sys/devices/system/cpu/cpu%i/cache/index%i/shared_cpu_list", cur_cpu, index);
+         const uint num_cpus = read_cpu_list(filename, pCPUs, max_cpus);
+         if (num_cpus)
+            return num_cpus;
+      }
+
+      sprintf(filename, "/sys/devices/system/cpu/cpu%i/topology/core_siblings_list", cur_cpu);
+      return read_cpu_list(filename, pCPUs, max_cpus);
+   }
+#else
+   uint lzham_get_cache_sharing_cpus(uint* pCPUs, uint max_cpus)
+   {
+      pCPUs, max_cpus;
+      return 0;
+   }
+#endif
+
 } // namespace lzham
 
 #endif // LZHAM_USE_PTHREADS_API
@@ -127,55 +127,67 @@ namespace lzham
       pthread_spinlock_t m_spinlock;
    };
 
-   template<typename T, uint cMaxSize>
-   class tsstack
+   // Lets threads sleep until other threads make a condition true, without missing a change made between checking the
+   // condition and going to sleep. A waiter calls prepare_wait(), checks its condition, and then calls cancel_wait() if it's
+   // true or wait() if it isn't. wait() returns once notify_all() has been called after prepare_wait(), and the condition
+   // must then be checked again. The condition must be changed with an atomic operation before calling notify_all(),
+   // which only reads a counter when nobody is waiting.
+   class event_count
    {
+      LZHAM_NO_COPY_OR_ASSIGNMENT_OP(event_count);
+
    public:
-      inline tsstack() : m_top(0)
+      inline event_count() : m_seq(0), m_num_waiters(0)
       {
+         if ((pthread_mutex_init(&m_mutex, NULL)) || (pthread_cond_init(&m_cond, NULL)))
+         {
+            LZHAM_FAIL("event_count: pthread_mutex_init() or pthread_cond_init() failed");
+         }
       }
 
-      inline ~tsstack()
+      inline ~event_count()
       {
+         pthread_cond_destroy(&m_cond);
+         pthread_mutex_destroy(&m_mutex);
       }
 
-      inline void clear()
+      inline atomic32_t prepare_wait()
       {
-         m_spinlock.lock();
-         m_top = 0;
-         m_spinlock.unlock();
+         atomic_increment32(&m_num_waiters);
+         return m_seq;
       }
 
-      inline bool try_push(const T& obj)
+      inline void cancel_wait()
       {
-         bool result = false;
-         m_spinlock.lock();
-         if (m_top < (int)cMaxSize)
-         {
-            m_stack[m_top++] = obj;
-            result = true;
-         }
-         m_spinlock.unlock();
-         return result;
+         atomic_decrement32(&m_num_waiters);
       }
 
-      inline bool pop(T& obj)
+      inline void wait(atomic32_t key)
       {
-         bool result = false;
-         m_spinlock.lock();
-         if (m_top > 0)
-         {
-            obj = m_stack[--m_top];
-            result = true;
-         }
-         m_spinlock.unlock();
-         return result;
+         pthread_mutex_lock(&m_mutex);
+         while (m_seq == key)
+            pthread_cond_wait(&m_cond, &m_mutex);
+         pthread_mutex_unlock(&m_mutex);
+
+         atomic_decrement32(&m_num_waiters);
+      }
+
+      inline void notify_all()
+      {
+         if (!m_num_waiters)
+            return;
+
+         pthread_mutex_lock(&m_mutex);
+         atomic_increment32(&m_seq);
+         pthread_cond_broadcast(&m_cond);
+         pthread_mutex_unlock(&m_mutex);
       }
 
    private:
-      spinlock m_spinlock;
-      T m_stack[cMaxSize];
-      int m_top;
+      volatile atomic32_t m_seq;
+      volatile atomic32_t m_num_waiters;
+      pthread_mutex_t m_mutex;
+      pthread_cond_t m_cond;
    };
 
    class task_pool
@@ -185,8 +197,12 @@ namespace lzham
       task_pool(uint num_threads);
       ~task_pool();
 
-      enum { cMaxThreads = 16 };
-      bool init(uint num_threads);
+      // cMaxTaskGroups is the number of groups that can queue tasks on one pool at once. Groups beyond that (and tasks
+      // that can't be queued because memory runs out) are executed immediately on the calling thread.
+      enum { cMaxTaskGroups = 64 };
+      // pCPUs optionally lists the CPUs (OS processor numbers) the threads may run on. CPUs the OS doesn't know or won't
+      // allow are ignored, and if none are left the threads run anywhere.
+      bool init(uint num_threads, const uint* pCPUs = NULL, uint num_cpus = 0);
       void deinit();
 
       inline uint get_num_threads() const { return m_num_threads; }
@@ -194,7 +210,6 @@ namespace lzham
 
       // C-style task callback
       typedef void (*task_callback_func)(uint64 data, void* pData_ptr);
-      bool queue_task(task_callback_func pFunc, uint64 data = 0, void* pData_ptr = NULL);
 
       class executable_task
       {
@@ -202,51 +217,133 @@ namespace lzham
          virtual void execute_task(uint64 data, void* pData_ptr) = 0;
       };
 
-      // It's the caller's responsibility to delete pObj within the execute_task() method, if needed!
-      bool queue_task(executable_task* pObj, uint64 data = 0, void* pData_ptr = NULL);
-
-      template<typename S, typename T>
-      inline bool queue_object_task(S* pObject, T pObject_method, uint64 data = 0, void* pData_ptr = NULL);
-
-      template<typename S, typename T>
-      inline bool queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks, void* pData_ptr = NULL);
-
-      void join();
+      class task_group;
 
    private:
       struct task
       {
-         inline task() : m_data(0), m_pData_ptr(NULL), m_pObj(NULL), m_flags(0) { }
-
-         uint64 m_data;
-         void* m_pData_ptr;
+         // Calls the function, executable_task or object method below.
+         void (*m_pInvoke)(const task& tsk);
 
          union
          {
             task_callback_func m_callback;
             executable_task* m_pObj;
+            void* m_pObject;
+         };
+
+         // Member function pointers vary in size, so they're stored as bytes and cast back by m_pInvoke.
+         enum { cMaxMethodSize = 4 * sizeof(void*) };
+         union
+         {
+            uint64 m_method_align;
+            uint8 m_method[cMaxMethodSize];
          };
 
-         uint m_flags;
+         uint64 m_data;
+         void* m_pData_ptr;
+
+         task_group* m_pGroup;
       };
 
-      tsstack<task, cMaxThreads> m_task_stack;
+   public:
+      // The tasks queued by one client of a pool that may be shared by several compressors, so the client can wait for
+      // (and help execute) its own tasks without waiting on anyone else's. Queued tasks are kept in a Chase-Lev work
+      // stealing deque: the thread that queues the group's tasks (and joins it) pushes and pops at one end, while the
+      // pool's threads and try_execute_task() steal from the other. It grows as needed.
+      class task_group
+      {
+         LZHAM_NO_COPY_OR_ASSIGNMENT_OP(task_group);
+
+      public:
+         task_group();
+         ~task_group();
 
-      uint m_num_threads;
-      pthread_t m_threads[cMaxThreads];
+         inline uint get_num_outstanding_tasks() const { return m_num_outstanding_tasks; }
 
-      semaphore m_tasks_available;
+      private:
+         friend class task_pool;
+         volatile atomic32_t m_num_outstanding_tasks;
 
-      enum task_flags
-      {
-         cTaskFlagObject = 1
+         // Array i holds 2^(cMinArraySizeLog2 + i) tasks. Outgrown arrays are only freed with the group, because a thief
+         // may still be reading from one.
+         enum { cMinArraySizeLog2 = 6, cMaxArrays = 20 };
+         task* m_arrays[cMaxArrays];
+         volatile atomic32_t m_cur_array;
+
+         volatile atomic32_t m_top;
+         volatile atomic32_t m_bottom;
+
+         task_pool* m_pPool;
+         uint m_pool_slot;
+
+         enum steal_status { cStealEmpty, cStealLostRace, cStealSucceeded };
+
+         bool push(const task& tsk, uint64 first_data, uint num_tasks);
+         bool pop(task& tsk);
+         steal_status steal(task& tsk);
       };
 
+      bool queue_task(task_callback_func pFunc, uint64 data = 0, void* pData_ptr = NULL);
+
+      // It's the caller's responsibility to delete pObj within the execute_task() method, if needed!
+      bool queue_task(executable_task* pObj, uint64 data = 0, void* pData_ptr = NULL);
+
+      template<typename S, typename T>
+      inline bool queue_object_task(S* pObject, T pObject_method, uint64 data = 0, void* pData_ptr = NULL);
+
+      // Queues num_tasks calls of pObject_method with data first_data, first_data + 1, etc. The group's tasks must all be
+      // queued (and joined) by the same thread at any one time. No memory is allocated unless the group's deque grows.
+      template<typename S, typename T>
+      inline bool queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks, void* pData_ptr = NULL, task_group *pGroup = NULL);
+
+      // Waits for all tasks (or only pGroup's tasks), executing queued tasks on the calling thread meanwhile. pGroup
+      // must be joined by the thread that queues its tasks.
+      void join(task_group *pGroup = NULL);
+
+      // Executes one of pGroup's queued tasks on the calling thread, if there is one. Any thread may call this.
+      bool try_execute_task(task_group *pGroup);
+
+   private:
+      // Tasks queued without a group. Any thread may queue them, so pushes are serialized by a lock.
+      task_group m_default_group;
+      spinlock m_default_group_lock;
+
+      // The groups the pool's threads steal from. A slot's thief count is raised while its group is being stolen from, so
+      // a group leaving the pool can wait for the thieves to finish with it.
+      spinlock m_groups_lock;
+      task_group* volatile m_groups[cMaxTaskGroups];
+      volatile atomic32_t m_group_thieves[cMaxTaskGroups];
+      volatile atomic32_t m_num_group_slots;
+
+      bool add_group(task_group* pGroup);
+      void remove_group(task_group* pGroup);
+
+      bool queue_tasks(const task& tsk, uint64 first_data, uint num_tasks);
+      bool try_steal_task(task& tsk);
+      void wait_for_tasks(volatile atomic32_t* pNum_outstanding_tasks);
+
+      // Sized by init() for the number of threads requested.
+      uint m_num_threads;
+      lzham::vector<pthread_t> m_threads;
+
+      semaphore m_tasks_available;
+
       volatile atomic32_t m_num_outstanding_tasks;
+
+      // Notified whenever a group's (or the pool's) last outstanding task completes. Joiners wait on the pool rather than on
+      // their groups, because a group may be destroyed as soon as its count reaches 0.
+      event_count m_tasks_done;
       volatile atomic32_t m_exit_flag;
 
       void process_task(task& tsk);
 
+      static void invoke_callback(const task& tsk);
+      static void invoke_executable_task(const task& tsk);
+
+      template<typename S, typename T>
+      static void invoke_object_method(const task& tsk);
+
       static void* thread_func(void *pContext);
    };
 
@@ -305,57 +402,40 @@ namespace lzham
       uint m_flags;
    };
 
+   template<typename S, typename T>
+   void task_pool::invoke_object_method(const task& tsk)
+   {
+      T pMethod;
+      memcpy(&pMethod, tsk.m_method, sizeof(pMethod));
+
+      (static_cast<S*>(tsk.m_pObject)->*pMethod)(tsk.m_data, tsk.m_pData_ptr);
+   }
+
    template<typename S, typename T>
    inline bool task_pool::queue_object_task(S* pObject, T pObject_method, uint64 data, void* pData_ptr)
    {
-      object_task<S> *pTask = lzham_new< object_task<S> >(pObject, pObject_method, cObjectTaskFlagDeleteAfterExecution);
-      if (!pTask)
-         return false;
-      return queue_task(pTask, data, pData_ptr);
+      return queue_multiple_object_tasks(pObject, pObject_method, data, 1, pData_ptr);
    }
 
    template<typename S, typename T>
-   inline bool task_pool::queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks, void* pData_ptr)
+   inline bool task_pool::queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks, void* pData_ptr, task_group *pGroup)
    {
       LZHAM_ASSERT(m_num_threads);
       LZHAM_ASSERT(pObject);
       LZHAM_ASSERT(num_tasks);
+      LZHAM_ASSUME(sizeof(T) <= task::cMaxMethodSize);
       if (!num_tasks)
          return true;
 
-      bool status = true;
-
-      uint i;
-      for (i = 0; i < num_tasks; i++)
-      {
-         task tsk;
-
-         tsk.m_pObj = lzham_new< object_task<S> >(pObject, pObject_method, cObjectTaskFlagDeleteAfterExecution);
-         if (!tsk.m_pObj)
-         {
-            status = false;
-            break;
-         }
+      task tsk;
+      tsk.m_pInvoke = invoke_object_method<S, T>;
+      tsk.m_pObject = pObject;
+      memcpy(tsk.m_method, &pObject_method, sizeof(pObject_method));
+      tsk.m_data = 0;
+      tsk.m_pData_ptr = pData_ptr;
+      tsk.m_pGroup = pGroup;
 
-         tsk.m_data = first_data + i;
-         tsk.m_pData_ptr = pData_ptr;
-         tsk.m_flags = cTaskFlagObject;
-
-         if (!m_task_stack.try_push(tsk))
-         {
-            status = false;
-            break;
-         }
-      }
-
-      if (i)
-      {
-         atomic_add32(&m_num_outstanding_tasks, i);
-
-         m_tasks_available.release(i);
-      }
-
-      return status;
+      return queue_tasks(tsk, first_data, num_tasks);
    }
 
    inline void lzham_sleep(unsigned int milliseconds)
@@ -375,6 +455,10 @@ namespace lzham
 #endif
    }
 
+   // Gets the CPUs sharing the last level cache (or failing that, the package) with the CPU the calling thread runs on.
+   // Returns the number of CPUs written to pCPUs, or 0 if the topology is unknown.
+   uint lzham_get_cache_sharing_cpus(uint* pCPUs, uint max_cpus);
+
 } // namespace lzham
 
 #endif // LZHAM_USE_PTHREADS_API
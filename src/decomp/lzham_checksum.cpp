@@ -37,6 +37,25 @@ namespace lzham
       }
       return (s2 << 16) + s1;
    }
+
+   uint adler32_combine(uint adler32_a, uint adler32_b, uint64 len_b)
+   {
+      const uint ADLER_MOD = 65521;
+      const uint rem = static_cast<uint>(len_b % ADLER_MOD);
+
+      uint s1 = adler32_a & 0xffff;
+      uint s2 = static_cast<uint>((static_cast<uint64>(rem) * s1) % ADLER_MOD);
+
+      s1 += (adler32_b & 0xffff) + ADLER_MOD - 1;
+      s2 += (adler32_a >> 16) + (adler32_b >> 16) + ADLER_MOD - rem;
+
+      if (s1 >= ADLER_MOD) s1 -= ADLER_MOD;
+      if (s1 >= ADLER_MOD) s1 -= ADLER_MOD;
+      if (s2 >= (ADLER_MOD << 1)) s2 -= (ADLER_MOD << 1);
+      if (s2 >= ADLER_MOD) s2 -= ADLER_MOD;
+
+      return (s2 << 16) | s1;
+   }
   
 } // namespace lzham
 
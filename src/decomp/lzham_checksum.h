@@ -6,5 +6,8 @@ namespace lzham
 {
    const uint cInitAdler32 = 1U;
    uint adler32(const void* pBuf, size_t buflen, uint adler32 = cInitAdler32);
+
+   // Returns the adler32 of the concatenation of two buffers, given the adler32 of each buffer and the length of the second.
+   uint adler32_combine(uint adler32_a, uint adler32_b, uint64 len_b);
    
 }  // namespace lzham
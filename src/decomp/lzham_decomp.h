@@ -11,12 +11,20 @@ namespace lzham
 
    lzham_uint32 lzham_lib_decompress_deinit(lzham_decompress_state_ptr p);
 
+   lzham_uint64 lzham_lib_decompress_get_memory_requirements(const lzham_decompress_params *pParams);
+
    lzham_decompress_status_t lzham_lib_decompress(
       lzham_decompress_state_ptr p,
       const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, 
       lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
       lzham_bool no_more_input_bytes_flag);
       
+   lzham_bool lzham_lib_decompress_reset(lzham_decompress_state_ptr p);
+
    lzham_decompress_status_t lzham_lib_decompress_memory(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
 
+   lzham_decompress_status_t lzham_lib_decompress_memory_with_state(lzham_decompress_state_ptr p, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32);
+
+   lzham_decompress_status_t lzham_lib_decompress_range(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint64 range_ofs);
+
 } // namespace lzham
@@ -25,6 +25,7 @@ namespace lzham
    struct lzham_decompressor
    {
       void init();
+      void reset_models(bool fast_table_updating, bool use_polar_codes);
       template<bool unbuffered> lzham_decompress_status_t decompress();
 
       int m_state;
@@ -34,6 +35,7 @@ namespace lzham
 
       uint8 *m_pRaw_decomp_buf;
       uint8 *m_pDecomp_buf;
+      bool m_decomp_buf_os_alloc;
       uint32 m_decomp_adler32;
 
       const uint8 *m_pIn_buf;
@@ -63,7 +65,7 @@ namespace lzham
       adaptive_bit_model m_is_rep1_model[CLZDecompBase::cNumStates];
       adaptive_bit_model m_is_rep2_model[CLZDecompBase::cNumStates];
       
-      uint m_dst_ofs;
+      size_t m_dst_ofs;
 
       uint m_step;
       uint m_block_step;
@@ -77,13 +79,14 @@ namespace lzham
       int m_match_hist3;
       uint m_cur_state;
 
-      uint m_start_block_dst_ofs;
+      size_t m_start_block_dst_ofs;
       uint m_prev_char;
       uint m_prev_prev_char;
 
       uint m_block_type;
 
       const uint8 *m_pFlush_src;
+      uint m_flushed_dst_ofs;
       size_t m_flush_num_bytes_remaining;
       size_t m_flush_n;
 
@@ -95,7 +98,7 @@ namespace lzham
       uint m_extra_bits;
       uint m_num_extra_bits;
 
-      uint m_src_ofs;
+      size_t m_src_ofs;
       const uint8* m_pCopy_src;
       uint m_num_raw_bytes_remaining;
 
@@ -153,10 +156,13 @@ namespace lzham
       #define LZHAM_MEMCPY memcpy
    #endif
 
+   // Outputs the bytes of the dictionary buffer from m_flushed_dst_ofs up to total_bytes (the whole window when it's full,
+   // or the bytes decoded so far at a sync block or the end of the stream).
    #define LZHAM_FLUSH_OUTPUT_BUFFER(total_bytes) \
       LZHAM_SAVE_STATE \
-      m_pFlush_src = m_pDecomp_buf; \
-      m_flush_num_bytes_remaining = total_bytes; \
+      m_pFlush_src = m_pDecomp_buf + m_flushed_dst_ofs; \
+      m_flush_num_bytes_remaining = (total_bytes) - m_flushed_dst_ofs; \
+      m_flushed_dst_ofs = (total_bytes) & dict_size_mask; \
       while (m_flush_num_bytes_remaining) \
       { \
          m_flush_n = LZHAM_MIN(m_flush_num_bytes_remaining, *m_pOut_buf_size); \
@@ -204,6 +210,7 @@ namespace lzham
       m_status = LZHAM_DECOMP_STATUS_NOT_FINISHED;
       
       m_dst_ofs = 0;
+      m_flushed_dst_ofs = 0;
 
       m_pIn_buf = NULL;
       m_pIn_buf_size = NULL;
@@ -214,6 +221,46 @@ namespace lzham
       m_pOrig_out_buf = NULL;
       m_orig_out_buf_size = 0;
       m_decomp_adler32 = cInitAdler32;
+
+      // The preset dictionary sits just behind the start of the circular window, so the first bytes of the stream can
+      // match against it.
+      if ((m_params.m_num_seed_bytes) && (m_pDecomp_buf))
+      {
+         const uint dict_size = 1U << m_params.m_dict_size_log2;
+         const uint num_seed_bytes = LZHAM_MIN(m_params.m_num_seed_bytes, dict_size);
+         const uint8 *pSeed_bytes = static_cast<const uint8 *>(m_params.m_pSeed_bytes) + (m_params.m_num_seed_bytes - num_seed_bytes);
+         memcpy(m_pDecomp_buf + dict_size - num_seed_bytes, pSeed_bytes, num_seed_bytes);
+      }
+   }
+
+   //------------------------------------------------------------------------------------------------------------------
+   void lzham_decompressor::reset_models(bool fast_table_updating, bool use_polar_codes)
+   {
+      for (uint i = 0; i < (1 << CLZDecompBase::cNumLitPredBits); i++)
+         m_lit_table[i].init(false, 256, fast_table_updating, use_polar_codes);
+
+      for (uint i = 0; i < (1 << CLZDecompBase::cNumDeltaLitPredBits); i++)
+         m_delta_lit_table[i].init(false, 256, fast_table_updating, use_polar_codes);
+
+      m_main_table.init(false, CLZDecompBase::cLZXNumSpecialLengths + (m_lzBase.m_num_lzx_slots - CLZDecompBase::cLZXLowestUsableMatchSlot) * 8, fast_table_updating, use_polar_codes);
+      for (uint i = 0; i < 2; i++)
+      {
+         m_rep_len_table[i].init(false, CLZDecompBase::cMaxMatchLen - CLZDecompBase::cMinMatchLen + 1, fast_table_updating, use_polar_codes);
+         m_large_len_table[i].init(false, CLZDecompBase::cLZXNumSecondaryLengths, fast_table_updating, use_polar_codes);
+      }
+      m_dist_lsb_table.init(false, 16, fast_table_updating, use_polar_codes);
+
+      for (uint i = 0; i < LZHAM_ARRAY_SIZE(m_is_match_model); i++)
+         m_is_match_model[i].clear();
+
+      for (uint i = 0; i < CLZDecompBase::cNumStates; i++)
+      {
+         m_is_rep_model[i].clear();
+         m_is_rep0_model[i].clear();
+         m_is_rep0_single_byte_model[i].clear();
+         m_is_rep1_model[i].clear();
+         m_is_rep2_model[i].clear();
+      }
    }
 
    //------------------------------------------------------------------------------------------------------------------
@@ -224,10 +271,12 @@ namespace lzham
       // returns must be either be a member variable, or saved/restored to a member variable.
       symbol_codec &codec = m_codec;
       const uint dict_size = 1U << m_params.m_dict_size_log2;
-      const uint dict_size_mask = unbuffered ? UINT_MAX : (dict_size - 1);
+      // In unbuffered mode the output buffer is the dictionary, which may be larger than 4GB.
+      const size_t dict_size_mask = unbuffered ? static_cast<size_t>(-1) : (dict_size - 1);
 
       int match_hist0 = 0, match_hist1 = 0, match_hist2 = 0, match_hist3 = 0;
-      uint cur_state = 0, prev_char = 0, prev_prev_char = 0, dst_ofs = 0;
+      uint cur_state = 0, prev_char = 0, prev_prev_char = 0;
+      size_t dst_ofs = 0;
       
       const size_t out_buf_size = *m_pOut_buf_size;
       
@@ -257,19 +306,7 @@ namespace lzham
             use_polar_codes = (tmp & 1) != 0;
          }
 
-         for (uint i = 0; i < (1 << CLZDecompBase::cNumLitPredBits); i++)
-            m_lit_table[i].init(false, 256, fast_table_updating, use_polar_codes);
-
-         for (uint i = 0; i < (1 << CLZDecompBase::cNumDeltaLitPredBits); i++)
-            m_delta_lit_table[i].init(false, 256, fast_table_updating, use_polar_codes);
-
-         m_main_table.init(false, CLZDecompBase::cLZXNumSpecialLengths + (m_lzBase.m_num_lzx_slots - CLZDecompBase::cLZXLowestUsableMatchSlot) * 8, fast_table_updating, use_polar_codes);
-         for (uint i = 0; i < 2; i++)
-         {
-            m_rep_len_table[i].init(false, CLZDecompBase::cMaxMatchLen - CLZDecompBase::cMinMatchLen + 1, fast_table_updating, use_polar_codes);
-            m_large_len_table[i].init(false, CLZDecompBase::cLZXNumSecondaryLengths, fast_table_updating, use_polar_codes);
-         }
-         m_dist_lsb_table.init(false, 16, fast_table_updating, use_polar_codes);
+         reset_models(fast_table_updating, use_polar_codes);
       }
 
       do
@@ -281,7 +318,13 @@ namespace lzham
 
          LZHAM_SYMBOL_CODEC_DECODE_GET_BITS(codec, m_block_type, 2);
 
-         if (m_block_type == CLZDecompBase::cRawBlock)
+         // More of the stream always follows a block header (at least the EOF block's adler32), so if the bit reader had to
+         // pad with zeros to get this far the stream was truncated. Zero padding would otherwise decode as endless reset blocks.
+         if (codec.m_decode_pad_bits > (uint)bit_count)
+         {
+            m_status = LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
+         }
+         else if (m_block_type == CLZDecompBase::cRawBlock)
          {
             uint num_raw_bytes_remaining;
             num_raw_bytes_remaining = 0;
@@ -292,11 +335,27 @@ namespace lzham
 #define LZHAM_RESTORE_LOCAL_STATE num_raw_bytes_remaining = m_num_raw_bytes_remaining;
 
             LZHAM_SYMBOL_CODEC_DECODE_GET_BITS(codec, num_raw_bytes_remaining, 24);
-            num_raw_bytes_remaining++;
 
             LZHAM_SYMBOL_CODEC_DECODE_ALIGN_TO_BYTE(codec);
 
-            do
+            if (num_raw_bytes_remaining == CLZDecompBase::cSyncBlockRawLen)
+            {
+               // Sync block: the compressor flushed, so hand over everything decoded so far before asking for more input.
+               num_raw_bytes_remaining = 0;
+
+               if ((!unbuffered) && (dst_ofs > m_flushed_dst_ofs))
+               {
+                  LZHAM_SYMBOL_CODEC_DECODE_END(codec);
+                  LZHAM_FLUSH_OUTPUT_BUFFER(dst_ofs);
+                  LZHAM_SYMBOL_CODEC_DECODE_BEGIN(codec);
+               }
+            }
+            else
+            {
+               num_raw_bytes_remaining++;
+            }
+
+            while (num_raw_bytes_remaining)
             {
                int b;
                LZHAM_SYMBOL_CODEC_DECODE_REMOVE_BYTE_FROM_BIT_BUF(codec, b);
@@ -322,7 +381,7 @@ namespace lzham
                }
 
                num_raw_bytes_remaining--;
-            } while (num_raw_bytes_remaining);
+            }
 
             LZHAM_SYMBOL_CODEC_DECODE_END(codec);
 
@@ -355,7 +414,7 @@ namespace lzham
                uint num_bytes_to_copy;
                num_bytes_to_copy = static_cast<uint>(LZHAM_MIN(num_raw_bytes_remaining, in_buf_remaining));
                if (!unbuffered)
-                  num_bytes_to_copy = LZHAM_MIN(num_bytes_to_copy, dict_size - dst_ofs);
+                  num_bytes_to_copy = LZHAM_MIN(num_bytes_to_copy, static_cast<uint>(dict_size - dst_ofs));
 
                if ((unbuffered) && ((dst_ofs + num_bytes_to_copy) > out_buf_size))
                {
@@ -430,7 +489,7 @@ namespace lzham
 
 #ifdef _DEBUG
 {
-               uint total_block_bytes = ((dst_ofs - m_start_block_dst_ofs) & dict_size_mask);
+               uint total_block_bytes = static_cast<uint>((dst_ofs - m_start_block_dst_ofs) & dict_size_mask);
                if (total_block_bytes > 0)
                {
                   LZHAM_ASSERT(prev_char == pDst[(dst_ofs - 1) & dict_size_mask]);
@@ -495,7 +554,8 @@ namespace lzham
                   else
                   {
                      // delta literal
-                     uint match_hist0_ofs, rep_lit0, rep_lit1;
+                     size_t match_hist0_ofs;
+                     uint rep_lit0, rep_lit1;
 
                      match_hist0_ofs = dst_ofs - match_hist0;
                      rep_lit0 = pDst[match_hist0_ofs & dict_size_mask];
@@ -706,7 +766,7 @@ namespace lzham
                      for ( ; ; ) { LZHAM_CR_RETURN(m_state, LZHAM_DECOMP_STATUS_FAILED_BAD_CODE); }
                   }
 
-                  uint src_ofs;
+                  size_t src_ofs;
                   const uint8* pCopy_src;
                   src_ofs = (dst_ofs - match_hist0) & dict_size_mask;
                   pCopy_src = pDst + src_ofs;
@@ -808,6 +868,13 @@ namespace lzham
          {
             m_status = LZHAM_DECOMP_STATUS_SUCCESS;
          }
+         else if (m_block_type == CLZDecompBase::cResetBlock)
+         {
+            // Start of an independently compressed chunk: the following blocks don't depend on any earlier model state.
+            uint tmp;
+            LZHAM_SYMBOL_CODEC_DECODE_GET_BITS(codec, tmp, 2);
+            reset_models((tmp & 2) != 0, (tmp & 1) != 0);
+         }
          else
          {
             m_status = LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
@@ -817,7 +884,7 @@ namespace lzham
 
       } while (m_status == LZHAM_DECOMP_STATUS_NOT_FINISHED);
 
-      if ((!unbuffered) && (dst_ofs))
+      if ((!unbuffered) && (dst_ofs > m_flushed_dst_ofs))
       {
          LZHAM_SYMBOL_CODEC_DECODE_END(codec);
          LZHAM_FLUSH_OUTPUT_BUFFER(dst_ofs);
@@ -876,18 +943,31 @@ namespace lzham
       if ((pParams->m_dict_size_log2 < CLZDecompBase::cMinDictSizeLog2) || (pParams->m_dict_size_log2 > CLZDecompBase::cMaxDictSizeLog2))
          return NULL;
 
+      if ((pParams->m_num_seed_bytes) && (!pParams->m_pSeed_bytes))
+         return NULL;
+
       lzham_decompressor *pState = lzham_new<lzham_decompressor>();
       if (!pState)
          return NULL;
 
       pState->m_params = *pParams;
 
-      if (pState->m_params.m_output_unbuffered)
+      // Matches into the preset dictionary reach back before the start of the output, so seeded streams need the window.
+      if (pState->m_params.m_num_seed_bytes)
+         pState->m_params.m_output_unbuffered = false;
+
+      pState->m_pRaw_decomp_buf = NULL;
+      pState->m_pDecomp_buf = NULL;
+      pState->m_decomp_buf_os_alloc = false;
+
+      if ((!pState->m_params.m_output_unbuffered) && (pState->m_params.m_alloc_policy))
       {
-         pState->m_pRaw_decomp_buf = NULL;
-         pState->m_pDecomp_buf = NULL;
+         // Pages from the OS are already aligned.
+         pState->m_pDecomp_buf = static_cast<uint8 *>(lzham_os_alloc(1U << pState->m_params.m_dict_size_log2, pState->m_params.m_alloc_policy, pState->m_params.m_numa_node));
+         pState->m_decomp_buf_os_alloc = (pState->m_pDecomp_buf != NULL);
       }
-      else
+
+      if ((!pState->m_params.m_output_unbuffered) && (!pState->m_decomp_buf_os_alloc))
       {
          pState->m_pRaw_decomp_buf = lzham_new_array<uint8>(static_cast<uint32>(1U << pState->m_params.m_dict_size_log2) + 15);
          if (!pState->m_pRaw_decomp_buf)
@@ -903,6 +983,27 @@ namespace lzham
       return pState;
    }
 
+   lzham_uint64 lzham_lib_decompress_get_memory_requirements(const lzham_decompress_params *pParams)
+   {
+      if ((!pParams) || (pParams->m_struct_size != sizeof(lzham_decompress_params)))
+         return 0;
+
+      if ((pParams->m_dict_size_log2 < CLZDecompBase::cMinDictSizeLog2) || (pParams->m_dict_size_log2 > CLZDecompBase::cMaxDictSizeLog2))
+         return 0;
+
+      CLZDecompBase lzbase;
+      lzbase.init_position_slots(pParams->m_dict_size_log2);
+
+      uint64 total = sizeof(lzham_decompressor) + lzbase.get_models_memory_requirements(false);
+
+      // The window, unless decoding straight into the caller's buffer (see lzham_lib_decompress_init()). It's an
+      // lzham_new_array() of dict size + 15 bytes, which lzham_malloc() rounds up to a multiple of 4.
+      if ((!pParams->m_output_unbuffered) || (pParams->m_num_seed_bytes))
+         total += LZHAM_MIN_ALLOC_ALIGNMENT + (1U << pParams->m_dict_size_log2) + 16;
+
+      return total;
+   }
+
    uint32 lzham_lib_decompress_deinit(lzham_decompress_state_ptr p)
    {
       lzham_decompressor *pState = static_cast<lzham_decompressor *>(p);
@@ -911,7 +1012,10 @@ namespace lzham
 
       uint32 adler32 = pState->m_decomp_adler32;
 
-      lzham_delete_array(pState->m_pRaw_decomp_buf);
+      if (pState->m_decomp_buf_os_alloc)
+         lzham_os_free(pState->m_pDecomp_buf, 1U << pState->m_params.m_dict_size_log2);
+      else
+         lzham_delete_array(pState->m_pRaw_decomp_buf);
       lzham_delete(pState);
 
       return adler32;
@@ -974,6 +1078,54 @@ namespace lzham
       return status;
    }
 
+   // Decodes an entire stream with a freshly initialized or reset decompressor.
+   static lzham_decompress_status_t decompress_memory_internal(lzham_decompressor *pState, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len)
+   {
+      if (!pDst_len)
+         return LZHAM_DECOMP_STATUS_INVALID_PARAMETER;
+
+      lzham_decompress_status_t status;
+
+      if (!pState->m_params.m_num_seed_bytes)
+      {
+         // The whole stream is decoded in a single call, so the caller's buffer can serve as the dictionary even if the
+         // state was created for buffered streaming.
+         const lzham_bool output_unbuffered = pState->m_params.m_output_unbuffered;
+         pState->m_params.m_output_unbuffered = true;
+
+         status = lzham_lib_decompress(pState, pSrc_buf, &src_len, pDst_buf, pDst_len, true);
+
+         pState->m_params.m_output_unbuffered = output_unbuffered;
+         return status;
+      }
+
+      // Seeded streams are decoded through the window, which is flushed into the caller's buffer as it fills.
+      const size_t dst_buf_size = *pDst_len;
+      size_t src_ofs = 0, dst_ofs = 0;
+      for ( ; ; )
+      {
+         size_t in_size = src_len - src_ofs;
+         size_t out_size = dst_buf_size - dst_ofs;
+
+         status = lzham_lib_decompress(pState, pSrc_buf + src_ofs, &in_size, pDst_buf + dst_ofs, &out_size, true);
+
+         src_ofs += in_size;
+         dst_ofs += out_size;
+
+         if (status >= LZHAM_DECOMP_STATUS_FIRST_SUCCESS_OR_FAILURE_CODE)
+            break;
+
+         if ((!out_size) && (dst_ofs == dst_buf_size))
+         {
+            status = LZHAM_DECOMP_STATUS_FAILED_DEST_BUF_TOO_SMALL;
+            break;
+         }
+      }
+
+      *pDst_len = dst_ofs;
+      return status;
+   }
+
    lzham_decompress_status_t lzham_lib_decompress_memory(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
    {
       if (!pParams)
@@ -986,7 +1138,7 @@ namespace lzham
       if (!pState)
          return LZHAM_DECOMP_STATUS_FAILED;
 
-      lzham_decompress_status_t status = lzham_lib_decompress(pState, pSrc_buf, &src_len, pDst_buf, pDst_len, true);
+      lzham_decompress_status_t status = decompress_memory_internal(static_cast<lzham_decompressor *>(pState), pDst_buf, pDst_len, pSrc_buf, src_len);
 
       uint32 adler32 = lzham_lib_decompress_deinit(pState);
       if (pAdler32)
@@ -995,4 +1147,153 @@ namespace lzham
       return status;
    }
 
+   lzham_bool lzham_lib_decompress_reset(lzham_decompress_state_ptr p)
+   {
+      lzham_decompressor *pState = static_cast<lzham_decompressor *>(p);
+      if (!pState)
+         return false;
+
+      // The dictionary buffer and the model tables are kept; init() rebuilds the models in place on the next stream.
+      pState->init();
+
+      return true;
+   }
+
+   lzham_decompress_status_t lzham_lib_decompress_memory_with_state(lzham_decompress_state_ptr p, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+   {
+      lzham_decompressor *pState = static_cast<lzham_decompressor *>(p);
+      if (!pState)
+         return LZHAM_DECOMP_STATUS_INVALID_PARAMETER;
+
+      lzham_lib_decompress_reset(pState);
+
+      lzham_decompress_status_t status = decompress_memory_internal(pState, pDst_buf, pDst_len, pSrc_buf, src_len);
+
+      if (pAdler32)
+         *pAdler32 = pState->m_decomp_adler32;
+
+      return status;
+   }
+
+   static inline uint64 read_le(const uint8 *pSrc, uint num_bytes)
+   {
+      uint64 val = 0;
+      for (uint i = 0; i < num_bytes; i++)
+         val |= static_cast<uint64>(pSrc[i]) << (i * 8);
+      return val;
+   }
+
+   lzham_decompress_status_t lzham_lib_decompress_range(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint64 range_ofs)
+   {
+      if ((!pParams) || (!pDst_len) || (!pSrc_buf))
+         return LZHAM_DECOMP_STATUS_INVALID_PARAMETER;
+
+      if ((*pDst_len) && (!pDst_buf))
+         return LZHAM_DECOMP_STATUS_INVALID_PARAMETER;
+
+      if (src_len < CLZDecompBase::cFrameFooterSize)
+         return LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
+
+      const uint8 *pFooter = pSrc_buf + src_len - CLZDecompBase::cFrameFooterSize;
+      const uint64 total_size = read_le(pFooter, 8);
+      const uint num_frames = static_cast<uint>(read_le(pFooter + 8, 4));
+      const uint frame_size = static_cast<uint>(read_le(pFooter + 12, 4));
+      if ((read_le(pFooter + 16, 4) != CLZDecompBase::cFrameFooterMagic) || (!frame_size))
+         return LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
+
+      if ((static_cast<uint64>(num_frames) * frame_size < total_size) || ((total_size + frame_size - 1) / frame_size != num_frames))
+         return LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
+
+      const uint64 index_size = static_cast<uint64>(num_frames) * CLZDecompBase::cFrameIndexEntrySize;
+      if (index_size > (src_len - CLZDecompBase::cFrameFooterSize))
+         return LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
+
+      const size_t frames_size = static_cast<size_t>(src_len - CLZDecompBase::cFrameFooterSize - index_size);
+      const uint8 *pIndex = pSrc_buf + frames_size;
+
+      if (range_ofs > total_size)
+         return LZHAM_DECOMP_STATUS_INVALID_PARAMETER;
+
+      const size_t range_len = static_cast<size_t>(LZHAM_MIN(static_cast<uint64>(*pDst_len), total_size - range_ofs));
+      *pDst_len = 0;
+
+      // One decompressor is reused for every frame in the range.
+      lzham_decompress_params params(*pParams);
+      params.m_output_unbuffered = true;
+
+      lzham_decompress_state_ptr pState = (range_len) ? lzham_lib_decompress_init(&params) : NULL;
+      if ((range_len) && (!pState))
+         return LZHAM_DECOMP_STATUS_FAILED;
+
+      uint8 *pFrame_buf = NULL;
+
+      lzham_decompress_status_t status = LZHAM_DECOMP_STATUS_SUCCESS;
+
+      size_t dst_ofs = 0;
+      for (uint frame_index = static_cast<uint>(range_ofs / frame_size); dst_ofs < range_len; frame_index++)
+      {
+         LZHAM_ASSERT(frame_index < num_frames);
+
+         const uint8 *pEntry = pIndex + static_cast<size_t>(frame_index) * CLZDecompBase::cFrameIndexEntrySize;
+         const uint64 frame_uncomp_ofs = read_le(pEntry, 8);
+         const uint64 frame_comp_ofs = read_le(pEntry + 8, 8);
+         const uint32 frame_adler32 = static_cast<uint32>(read_le(pEntry + 16, 4));
+         const uint64 next_comp_ofs = ((frame_index + 1) < num_frames) ? read_le(pEntry + CLZDecompBase::cFrameIndexEntrySize + 8, 8) : frames_size;
+
+         const uint frame_uncomp_size = static_cast<uint>(LZHAM_MIN(static_cast<uint64>(frame_size), total_size - frame_uncomp_ofs));
+
+         if ((frame_uncomp_ofs != static_cast<uint64>(frame_index) * frame_size) || (frame_comp_ofs > next_comp_ofs) || (next_comp_ofs > frames_size))
+         {
+            status = LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
+            break;
+         }
+
+         const size_t ofs_in_frame = static_cast<size_t>(range_ofs + dst_ofs - frame_uncomp_ofs);
+         const size_t bytes_wanted = LZHAM_MIN(range_len - dst_ofs, frame_uncomp_size - ofs_in_frame);
+
+         // Frames entirely covered by the range are decoded straight into the caller's buffer; the partial ones at either
+         // end go through a temporary frame buffer.
+         const bool whole_frame = (!ofs_in_frame) && (bytes_wanted == frame_uncomp_size);
+         if ((!whole_frame) && (!pFrame_buf))
+         {
+            pFrame_buf = lzham_new_array<uint8>(frame_size);
+            if (!pFrame_buf)
+            {
+               status = LZHAM_DECOMP_STATUS_FAILED;
+               break;
+            }
+         }
+
+         size_t frame_dst_len = frame_uncomp_size;
+         uint32 adler32 = 0;
+         status = lzham_lib_decompress_memory_with_state(pState, whole_frame ? (pDst_buf + dst_ofs) : pFrame_buf, &frame_dst_len, pSrc_buf + frame_comp_ofs, static_cast<size_t>(next_comp_ofs - frame_comp_ofs), &adler32);
+         if (status != LZHAM_DECOMP_STATUS_SUCCESS)
+            break;
+
+         if (frame_dst_len != frame_uncomp_size)
+         {
+            status = LZHAM_DECOMP_STATUS_FAILED_BAD_CODE;
+            break;
+         }
+
+         if (adler32 != frame_adler32)
+         {
+            status = LZHAM_DECOMP_STATUS_FAILED_ADLER32;
+            break;
+         }
+
+         if (!whole_frame)
+            memcpy(pDst_buf + dst_ofs, pFrame_buf + ofs_in_frame, bytes_wanted);
+
+         dst_ofs += bytes_wanted;
+      }
+
+      lzham_delete_array(pFrame_buf);
+      lzham_lib_decompress_deinit(pState);
+
+      *pDst_len = dst_ofs;
+
+      return status;
+   }
+
 } // namespace lzham
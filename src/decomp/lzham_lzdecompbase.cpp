@@ -2,6 +2,7 @@
 // See Copyright Notice and license at the end of include/lzham.h
 #include "lzham_core.h"
 #include "lzham_lzdecompbase.h"
+#include "lzham_symbol_codec.h"
 
 namespace lzham
 {
@@ -42,5 +43,19 @@ namespace lzham
       
       LZHAM_VERIFY(m_num_lzx_slots);
    }
+
+   uint CLZDecompBase::get_models_memory_requirements(bool encoding) const
+   {
+      typedef raw_quasi_adaptive_huffman_data_model model;
+
+      uint total = 0;
+      total += (1 << cNumLitPredBits) * model::get_memory_requirements(encoding, 256);
+      total += (1 << cNumDeltaLitPredBits) * model::get_memory_requirements(encoding, 256);
+      total += model::get_memory_requirements(encoding, cLZXNumSpecialLengths + (m_num_lzx_slots - cLZXLowestUsableMatchSlot) * 8);
+      total += 2 * model::get_memory_requirements(encoding, cMaxMatchLen - cMinMatchLen + 1);
+      total += 2 * model::get_memory_requirements(encoding, cLZXNumSecondaryLengths);
+      total += model::get_memory_requirements(encoding, 16);
+      return total;
+   }
    
 } //namespace lzham
@@ -47,11 +47,25 @@ namespace lzham
       {
          cBlockHeaderBits = 2,
          
+         // Resets all models and reads a new configuration, so the data that follows can be decoded independently of the preceding blocks.
+         cResetBlock = 0,
          cCompBlock = 1,
          cRawBlock = 2,
-         cEOFBlock = 3
+         cEOFBlock = 3,
+
+         // A raw block whose 24-bit length field (length - 1) has this value is an empty sync block, written by sync and
+         // full flushes. It contains no data, and tells the decompressor to output everything decoded so far.
+         cSyncBlockRawLen = 0xFFFFFF
       };
       
+      // Seekable framed container trailer (see lzham_compress_framed_memory()). All fields are little endian.
+      enum
+      {
+         cFrameIndexEntrySize = 20,          // uncompressed offset (8), compressed offset (8), adler32 (4)
+         cFrameFooterSize = 20,              // total uncompressed size (8), number of frames (4), frame size (4), magic (4)
+         cFrameFooterMagic = 0x46485A4C      // "LZHF"
+      };
+
       enum
       {
          cNumStates = 12,
@@ -72,6 +86,10 @@ namespace lzham
       uint8 m_lzx_position_extra_bits[cLZXMaxPositionSlots];
       
       void init_position_slots(uint dict_size_log2);
+
+      // Heap bytes allocated by one complete set of Huffman models (literal, delta literal, main, length and distance tables).
+      // Requires init_position_slots().
+      uint get_models_memory_requirements(bool encoding) const;
    };
    
 } // namespace lzham
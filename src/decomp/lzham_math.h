@@ -6,6 +6,10 @@
    #include <intrin.h>
    #if defined(_MSC_VER)
       #pragma intrinsic(_BitScanReverse)
+      #pragma intrinsic(_BitScanForward)
+      #if defined(_WIN64)
+         #pragma intrinsic(_BitScanForward64)
+      #endif
    #endif
 #endif
 
@@ -113,6 +117,33 @@ namespace lzham
          return l;
       }
 
+      // Returns the index of the lowest set bit. v must not be 0.
+      inline uint count_trailing_zero_bits64(uint64 v)
+      {
+         LZHAM_ASSERT(v);
+#if defined(__GNUC__)
+         return static_cast<uint>(__builtin_ctzll(v));
+#elif defined(LZHAM_USE_MSVC_INTRINSICS) && defined(_WIN64)
+         unsigned long l;
+         _BitScanForward64(&l, v);
+         return l;
+#elif defined(LZHAM_USE_MSVC_INTRINSICS)
+         unsigned long l;
+         if (_BitScanForward(&l, static_cast<uint32>(v)))
+            return l;
+         _BitScanForward(&l, static_cast<uint32>(v >> 32U));
+         return 32 + l;
+#else
+         uint l = 0;
+         while (!(v & 1U))
+         {
+            v >>= 1U;
+            l++;
+         }
+         return l;
+#endif
+      }
+
    }
 
 } // namespace lzham
@@ -11,6 +11,12 @@ using namespace lzham;
    #define _msize malloc_usable_size
 #endif
 
+#if defined(__linux__)
+   #include <sys/mman.h>
+   #include <sys/syscall.h>
+   #include <unistd.h>
+#endif
+
 namespace lzham
 {
    #if LZHAM_64BIT_POINTERS
@@ -259,6 +265,123 @@ namespace lzham
       }
    }
 
+#if LZHAM_PLATFORM_PC && LZHAM_USE_WIN32_API
+   typedef LPVOID (WINAPI *virtual_alloc_ex_numa_func)(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect, DWORD nndPreferred);
+   typedef SIZE_T (WINAPI *get_large_page_minimum_func)(void);
+
+   static void* os_alloc_pages(size_t size, DWORD alloc_type, uint policy, uint numa_node)
+   {
+      // Resolved at runtime, these aren't available on every supported version of Windows.
+      HMODULE hKernel32 = GetModuleHandleA("kernel32.dll");
+      virtual_alloc_ex_numa_func pVirtual_alloc_ex_numa = hKernel32 ? reinterpret_cast<virtual_alloc_ex_numa_func>(GetProcAddress(hKernel32, "VirtualAllocExNuma")) : NULL;
+
+      if ((policy & LZHAM_ALLOC_POLICY_NUMA_NODE) && (pVirtual_alloc_ex_numa))
+         return (*pVirtual_alloc_ex_numa)(GetCurrentProcess(), NULL, size, alloc_type, PAGE_READWRITE, numa_node);
+
+      return VirtualAlloc(NULL, size, alloc_type, PAGE_READWRITE);
+   }
+
+   void* lzham_os_alloc(size_t size, uint policy, uint numa_node)
+   {
+      if ((!size) || (!policy) || (size > MAX_POSSIBLE_BLOCK_SIZE))
+         return NULL;
+
+      // Large pages need SeLockMemoryPrivilege, so if the process doesn't hold it this fails and regular pages are used.
+      if (policy & LZHAM_ALLOC_POLICY_HUGE_PAGES)
+      {
+         HMODULE hKernel32 = GetModuleHandleA("kernel32.dll");
+         get_large_page_minimum_func pGet_large_page_minimum = hKernel32 ? reinterpret_cast<get_large_page_minimum_func>(GetProcAddress(hKernel32, "GetLargePageMinimum")) : NULL;
+         const size_t large_page_size = pGet_large_page_minimum ? (*pGet_large_page_minimum)() : 0;
+         if (large_page_size)
+         {
+            void* p = os_alloc_pages((size + large_page_size - 1) & ~(large_page_size - 1), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, policy, numa_node);
+            if (p)
+               return p;
+         }
+      }
+
+      return os_alloc_pages(size, MEM_RESERVE | MEM_COMMIT, policy, numa_node);
+   }
+
+   void lzham_os_free(void* p, size_t size)
+   {
+      size;
+      if (p)
+         VirtualFree(p, 0, MEM_RELEASE);
+   }
+#elif defined(__linux__)
+   // Transparent huge pages are only used for 2MB aligned ranges.
+   const uint cOSHugePageSize = 2U * 1024U * 1024U;
+
+   static size_t get_os_alloc_size(size_t size)
+   {
+      return (size + cOSHugePageSize - 1) & ~static_cast<size_t>(cOSHugePageSize - 1);
+   }
+
+   void* lzham_os_alloc(size_t size, uint policy, uint numa_node)
+   {
+      if ((!size) || (!policy) || (size > MAX_POSSIBLE_BLOCK_SIZE))
+         return NULL;
+
+      // Over-allocate by a huge page, then trim the unaligned head and the tail.
+      const size_t alloc_size = get_os_alloc_size(size);
+      uint8* pMap = static_cast<uint8*>(mmap(NULL, alloc_size + cOSHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if (pMap == MAP_FAILED)
+         return NULL;
+
+      uint8* p = math::align_up_pointer(pMap, cOSHugePageSize);
+      if (p != pMap)
+         munmap(pMap, p - pMap);
+      if ((pMap + cOSHugePageSize) != p)
+         munmap(p + alloc_size, (pMap + cOSHugePageSize) - p);
+
+      // Both are only hints: the buffer is usable even if the kernel doesn't support or allow them. They must be applied
+      // before the pages are first touched.
+#ifdef MADV_HUGEPAGE
+      if (policy & LZHAM_ALLOC_POLICY_HUGE_PAGES)
+         madvise(p, alloc_size, MADV_HUGEPAGE);
+#endif
+
+#ifdef SYS_mbind
+      if (policy & LZHAM_ALLOC_POLICY_NUMA_NODE)
+      {
+         const int cMPOL_PREFERRED = 1;
+         unsigned long node_mask[1024 / (sizeof(unsigned long) * 8)];
+         if (numa_node < sizeof(node_mask) * 8)
+         {
+            memset(node_mask, 0, sizeof(node_mask));
+            node_mask[numa_node / (sizeof(unsigned long) * 8)] = 1UL << (numa_node % (sizeof(unsigned long) * 8));
+            syscall(SYS_mbind, p, alloc_size, cMPOL_PREFERRED, node_mask, sizeof(node_mask) * 8 + 1, 0);
+         }
+      }
+#else
+      numa_node;
+#endif
+
+      return p;
+   }
+
+   void lzham_os_free(void* p, size_t size)
+   {
+      if (p)
+         munmap(p, get_os_alloc_size(size));
+   }
+#else
+   void* lzham_os_alloc(size_t size, uint policy, uint numa_node)
+   {
+      size;
+      policy;
+      numa_node;
+      return NULL;
+   }
+
+   void lzham_os_free(void* p, size_t size)
+   {
+      p;
+      size;
+   }
+#endif
+
    void lzham_print_mem_stats()
    {
 #if LZHAM_MEM_STATS
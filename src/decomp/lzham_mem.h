@@ -11,6 +11,11 @@ namespace lzham
    void     lzham_free(void* p);
    size_t   lzham_msize(void* p);
 
+   // Page granular allocations made directly by the OS, for the big randomly accessed buffers (see lzham_alloc_policy_flags).
+   // These don't go through the memory callbacks. Returns NULL if the policy is 0 or can't be used on this platform.
+   void*    lzham_os_alloc(size_t size, uint policy, uint numa_node);
+   void     lzham_os_free(void* p, size_t size);
+
    template<typename T>
    inline T* lzham_new()
    {
@@ -107,6 +112,76 @@ namespace lzham
       }
    }   
    
+   // Fixed size array of POD elements for the dictionary and match finder tables. It's allocated with lzham_os_alloc() if
+   // an allocation policy is given, falling back to lzham_malloc() if that fails. Elements aren't constructed.
+   template<typename T>
+   class large_array
+   {
+      large_array(const large_array&);
+      large_array& operator= (const large_array&);
+
+   public:
+      large_array() : m_p(NULL), m_size(0), m_policy(0), m_numa_node(0), m_os_alloc(false) { }
+      ~large_array() { clear(); }
+
+      // The contents are undefined afterwards. The current block is kept if the size and policy are unchanged.
+      bool try_resize_no_construct(uint size, uint policy = 0, uint numa_node = 0)
+      {
+         if ((m_p) && (size == m_size) && (policy == m_policy) && (numa_node == m_numa_node))
+            return true;
+
+         clear();
+         if (!size)
+            return true;
+
+         const size_t num_bytes = static_cast<size_t>(size) * sizeof(T);
+         if (policy)
+         {
+            m_p = static_cast<T*>(lzham_os_alloc(num_bytes, policy, numa_node));
+            m_os_alloc = (m_p != NULL);
+         }
+         if (!m_p)
+         {
+            m_p = static_cast<T*>(lzham_malloc(num_bytes));
+            if (!m_p)
+               return false;
+         }
+
+         m_size = size;
+         m_policy = policy;
+         m_numa_node = numa_node;
+         return true;
+      }
+
+      void clear()
+      {
+         if (m_os_alloc)
+            lzham_os_free(m_p, size_in_bytes());
+         else
+            lzham_free(m_p);
+
+         m_p = NULL;
+         m_size = 0;
+         m_os_alloc = false;
+      }
+
+      inline uint size() const { return m_size; }
+      inline size_t size_in_bytes() const { return static_cast<size_t>(m_size) * sizeof(T); }
+
+      inline T* get_ptr() { return m_p; }
+      inline const T* get_ptr() const { return m_p; }
+
+      inline T& operator[] (uint i) { LZHAM_ASSERT(i < m_size); return m_p[i]; }
+      inline const T& operator[] (uint i) const { LZHAM_ASSERT(i < m_size); return m_p[i]; }
+
+   private:
+      T* m_p;
+      uint m_size;
+      uint m_policy;
+      uint m_numa_node;
+      bool m_os_alloc;
+   };
+
    void lzham_print_mem_stats();
 
 } // namespace lzham
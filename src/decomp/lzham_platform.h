@@ -21,6 +21,15 @@ void lzham_fail(const char* pExp, const char* pFile, unsigned line);
    #define LZHAM_BUILTIN_EXPECT(c, v) c
 #endif
 
+// Hints that the cache line holding p will be read soon.
+#if defined(__GNUC__)
+   #define LZHAM_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(WIN32) && LZHAM_PLATFORM_PC
+   #define LZHAM_PREFETCH(p) PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, p)
+#else
+   #define LZHAM_PREFETCH(p)
+#endif
+
 #if defined(__GNUC__) && LZHAM_PLATFORM_PC
 extern __inline__ __attribute__((__always_inline__,__gnu_inline__)) void lzham_yield_processor()
 {
@@ -330,8 +330,31 @@ namespace lzham
       m_use_polar_codes = false;
    }
 
+   uint raw_quasi_adaptive_huffman_data_model::get_memory_requirements(bool encoding, uint total_syms)
+   {
+      uint total = total_syms * (sizeof(uint16) + sizeof(uint8));
+
+      if (encoding)
+         total += total_syms * sizeof(uint16);
+      else
+      {
+         const uint table_bits = (total_syms <= 16) ? 0 : math::minimum(1 + math::ceil_log2i(total_syms), prefix_coding::cMaxTableBits);
+
+         // The decoder tables are lzham_new_array()'s, each with a LZHAM_MIN_ALLOC_ALIGNMENT header.
+         total += sizeof(prefix_coding::decoder_tables) + LZHAM_MIN_ALLOC_ALIGNMENT + total_syms * sizeof(uint16);
+         if (table_bits)
+            total += LZHAM_MIN_ALLOC_ALIGNMENT + (1U << table_bits) * sizeof(uint32);
+      }
+
+      return total;
+   }
+
    bool raw_quasi_adaptive_huffman_data_model::init(bool encoding, uint total_syms, bool fast_updating, bool use_polar_codes)
    {
+      // Reinitializing with the same configuration (a reused compressor or decompressor): keep the existing allocations.
+      if ((m_total_syms) && (m_total_syms == total_syms) && (m_encoding == encoding) && (m_fast_updating == fast_updating) && (m_use_polar_codes == use_polar_codes))
+         return reset();
+
       clear();
 
       m_encoding = encoding;
@@ -615,6 +638,7 @@ namespace lzham
       m_pDecode_buf_next = NULL;
       m_pDecode_buf_end = NULL;
       m_decode_buf_size = 0;
+      m_decode_pad_bits = 0;
 
       m_bit_buf = 0;
       m_bit_count = 0;
@@ -630,6 +654,10 @@ namespace lzham
       m_output_buf.clear();
       m_arith_output_buf.clear();
       m_output_syms.clear();
+
+      m_pExternal_output_buf = NULL;
+      m_external_output_size = 0;
+      m_external_output_ofs = 0;
    }
 
    bool symbol_codec::start_encoding(uint expected_file_size)
@@ -858,6 +886,15 @@ namespace lzham
       return true;
    }
 
+   uint64 symbol_codec::get_encoding_memory_requirements(uint expected_file_size, uint max_syms)
+   {
+      // The output buffer is reserved up front, the symbol buffer grows to the next power of 2, and the arithmetic coder's
+      // bytes can't outnumber the output's.
+      uint64 total = static_cast<uint64>(expected_file_size) * 2;
+      total += math::next_pow2_64(max_syms) * sizeof(output_symbol);
+      return total;
+   }
+
    bool symbol_codec::stop_encoding(bool support_arith)
    {
       LZHAM_ASSERT(m_mode == cEncoding);
@@ -902,6 +939,10 @@ namespace lzham
       m_bit_buf = 0;
       m_bit_count = cBitBufSize;
 
+      m_pExternal_output_buf = NULL;
+      m_external_output_size = 0;
+      m_external_output_ofs = 0;
+
       m_output_buf.try_resize(0);
       if (!m_output_buf.try_reserve(expected_size))
          return false;
@@ -924,7 +965,16 @@ namespace lzham
 
       while (m_bit_count <= (cBitBufSize - 8))
       {
-         if (!m_output_buf.try_push_back(static_cast<uint8>(m_bit_buf >> (cBitBufSize - 8))))
+         const uint8 c = static_cast<uint8>(m_bit_buf >> (cBitBufSize - 8));
+
+         if (m_pExternal_output_buf)
+         {
+            if (m_external_output_ofs < m_external_output_size)
+               m_pExternal_output_buf[m_external_output_ofs++] = c;
+            else if ((!spill_external_output_buf()) || (!m_output_buf.try_push_back(c)))
+               return false;
+         }
+         else if (!m_output_buf.try_push_back(c))
             return false;
 
          m_bit_buf <<= 8;
@@ -934,6 +984,30 @@ namespace lzham
       return true;
    }
 
+   void symbol_codec::set_external_output_buf(uint8* pBuf, uint buf_size)
+   {
+      LZHAM_ASSERT(m_mode == cEncoding);
+
+      m_pExternal_output_buf = buf_size ? pBuf : NULL;
+      m_external_output_size = buf_size;
+      m_external_output_ofs = 0;
+   }
+
+   // Out of room in the caller's buffer: move what's been written so far over to the internal buffer and continue there.
+   bool symbol_codec::spill_external_output_buf()
+   {
+      LZHAM_ASSERT(m_pExternal_output_buf);
+
+      m_output_buf.try_resize(0);
+      bool status = m_output_buf.append(m_pExternal_output_buf, m_external_output_ofs);
+
+      m_pExternal_output_buf = NULL;
+      m_external_output_size = 0;
+      m_external_output_ofs = 0;
+
+      return status;
+   }
+
    bool symbol_codec::put_bits_align_to_byte()
    {
       uint num_bits_in = cBitBufSize - m_bit_count;
@@ -1041,6 +1115,7 @@ namespace lzham
       m_pDecode_need_bytes_func = pNeed_bytes_func;
       m_pDecode_private_data = pPrivate_data;
       m_decode_buf_eof = eof_flag;
+      m_decode_pad_bits = 0;
 
       m_bit_buf = 0;
       m_bit_count = 0;
@@ -43,6 +43,9 @@ namespace lzham
       inline uint get_total_syms() const { return m_total_syms; }
       inline bit_cost_t get_cost(uint sym) const { return m_code_sizes[sym] << cBitCostScaleShift; }
 
+      // Heap bytes allocated by init() for the given configuration (the model object itself isn't included).
+      static uint get_memory_requirements(bool encoding, uint total_syms);
+
    public:
       lzham::vector<uint16>            m_sym_freq;
 
@@ -150,11 +153,21 @@ namespace lzham
 
       inline uint encode_get_total_bits_written() const { return m_total_bits_written; }
 
+      // Optional caller supplied output buffer for the next stop_encoding(): the final bitstream is assembled directly into
+      // it, and only moved to the internal encoding buffer if it runs out of space.
+      void set_external_output_buf(uint8* pBuf, uint buf_size);
+      inline uint get_external_output_size() const { return m_pExternal_output_buf ? m_external_output_ofs : 0; }
+
       bool stop_encoding(bool support_arith);
 
+      // Worst case heap bytes used while encoding up to max_syms symbols into expected_file_size bytes.
+      static uint64 get_encoding_memory_requirements(uint expected_file_size, uint max_syms);
+
       const lzham::vector<uint8>& get_encoding_buf() const  { return m_output_buf; }
             lzham::vector<uint8>& get_encoding_buf()        { return m_output_buf; }
 
+      inline uint get_encoding_size() const { return m_pExternal_output_buf ? m_external_output_ofs : m_output_buf.size(); }
+
       // Decoding
 
       typedef void (*need_bytes_func_ptr)(size_t num_bytes_consumed, void *pPrivate_data, const uint8* &pBuf, size_t &buf_size, bool &eof_flag);
@@ -192,6 +205,9 @@ namespace lzham
       size_t                  m_decode_buf_size;
       bool                    m_decode_buf_eof;
 
+      // Zero bits the decoding macros have fed into the bit buffer after the input ran out. They sit behind any real bits.
+      uint                    m_decode_pad_bits;
+
       need_bytes_func_ptr     m_pDecode_need_bytes_func;
       void*                   m_pDecode_private_data;
 
@@ -211,6 +227,10 @@ namespace lzham
       lzham::vector<uint8>    m_output_buf;
       lzham::vector<uint8>    m_arith_output_buf;
 
+      uint8*                  m_pExternal_output_buf;
+      uint                    m_external_output_size;
+      uint                    m_external_output_ofs;
+
       struct output_symbol
       {
          uint m_bits;
@@ -246,6 +266,7 @@ namespace lzham
       bool arith_stop_encoding();
 
       bool put_bits(uint bits, uint num_bits);
+      bool spill_external_output_buf();
       bool put_bits_align_to_byte();
       bool flush_bits();
       bool assemble_output_buf();
@@ -300,7 +321,7 @@ namespace lzham
             LZHAM_SYMBOL_CODEC_DECODE_BEGIN(codec) \
          } \
          c = 0; \
-         if (LZHAM_BUILTIN_EXPECT(pDecode_buf_next < codec.m_pDecode_buf_end, 1)) c = *pDecode_buf_next++; \
+         if (LZHAM_BUILTIN_EXPECT(pDecode_buf_next < codec.m_pDecode_buf_end, 1)) c = *pDecode_buf_next++; else codec.m_decode_pad_bits += 8; \
       } \
       else \
          c = *pDecode_buf_next++; \
@@ -361,7 +382,7 @@ namespace lzham
                LZHAM_SYMBOL_CODEC_DECODE_BEGIN(codec) \
                pModel = codec.m_pSaved_huff_model; pTables = pModel->m_pDecode_tables; \
             } \
-            c = 0; if (pDecode_buf_next < codec.m_pDecode_buf_end) c = *pDecode_buf_next++; \
+            c = 0; if (pDecode_buf_next < codec.m_pDecode_buf_end) c = *pDecode_buf_next++; else codec.m_decode_pad_bits += 8; \
             bit_count += 8; \
             bit_buf |= (static_cast<symbol_codec::bit_buf_t>(c) << (symbol_codec::cBitBufSize - bit_count)); \
          } \
@@ -423,7 +444,7 @@ namespace lzham
             LZHAM_SYMBOL_CODEC_DECODE_BEGIN(codec) \
             pModel = codec.m_pSaved_huff_model; pTables = pModel->m_pDecode_tables; \
          } \
-         c = 0; if (LZHAM_BUILTIN_EXPECT(pDecode_buf_next < codec.m_pDecode_buf_end, 1)) c = *pDecode_buf_next++; \
+         c = 0; if (LZHAM_BUILTIN_EXPECT(pDecode_buf_next < codec.m_pDecode_buf_end, 1)) c = *pDecode_buf_next++; else codec.m_decode_pad_bits += 8; \
       } \
       else \
          c = *pDecode_buf_next++; \
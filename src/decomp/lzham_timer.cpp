@@ -22,6 +22,18 @@ namespace lzham
       {
          QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(pTicks));
       }
+   #elif defined(CLOCK_MONOTONIC)
+      // Wall clock time in microseconds. clock() is process CPU time, which includes every helper thread.
+      inline void query_counter(timer_ticks *pTicks)
+      {
+         timespec ts;
+         clock_gettime(CLOCK_MONOTONIC, &ts);
+         *pTicks = static_cast<timer_ticks>(ts.tv_sec) * 1000000ULL + static_cast<timer_ticks>(ts.tv_nsec / 1000);
+      }
+      inline void query_counter_frequency(timer_ticks *pTicks)
+      {
+         *pTicks = 1000000ULL;
+      }
    #else
       inline void query_counter(timer_ticks *pTicks)
       {
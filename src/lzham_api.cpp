@@ -33,11 +33,41 @@ extern "C" LZHAM_DLL_EXPORT lzham_decompress_status_t lzham_decompress(
    return lzham::lzham_lib_decompress(p, pIn_buf, pIn_buf_size, pOut_buf, pOut_buf_size, no_more_input_bytes_flag);
 }   
 
+extern "C" LZHAM_DLL_EXPORT lzham_bool lzham_decompress_reset(lzham_decompress_state_ptr p)
+{
+   return lzham::lzham_lib_decompress_reset(p);
+}
+
+extern "C" LZHAM_DLL_EXPORT lzham_uint64 lzham_decompress_get_memory_requirements(const lzham_decompress_params *pParams)
+{
+   return lzham::lzham_lib_decompress_get_memory_requirements(pParams);
+}
+
 extern "C" LZHAM_DLL_EXPORT lzham_decompress_status_t lzham_decompress_memory(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
 {
    return lzham::lzham_lib_decompress_memory(pParams, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
 }
 
+extern "C" LZHAM_DLL_EXPORT lzham_decompress_status_t lzham_decompress_memory_with_state(lzham_decompress_state_ptr p, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+{
+   return lzham::lzham_lib_decompress_memory_with_state(p, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
+}
+
+extern "C" LZHAM_DLL_EXPORT lzham_decompress_status_t lzham_decompress_range(const lzham_decompress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint64 range_ofs)
+{
+   return lzham::lzham_lib_decompress_range(pParams, pDst_buf, pDst_len, pSrc_buf, src_len, range_ofs);
+}
+
+extern "C" LZHAM_DLL_EXPORT lzham_task_pool_ptr lzham_create_task_pool(lzham_uint32 num_threads)
+{
+   return lzham::lzham_lib_create_task_pool(num_threads);
+}
+
+extern "C" LZHAM_DLL_EXPORT void lzham_destroy_task_pool(lzham_task_pool_ptr pPool)
+{
+   lzham::lzham_lib_destroy_task_pool(pPool);
+}
+
 extern "C" LZHAM_DLL_EXPORT lzham_compress_state_ptr lzham_compress_init(const lzham_compress_params *pParams)
 {
    return lzham::lzham_lib_compress_init(pParams);
@@ -57,8 +87,41 @@ extern "C" LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress(
    return lzham::lzham_lib_compress(p, pIn_buf, pIn_buf_size, pOut_buf, pOut_buf_size, no_more_input_bytes_flag);
 }   
 
+extern "C" LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress2(
+   lzham_compress_state_ptr p,
+   const lzham_uint8 *pIn_buf, size_t *pIn_buf_size, 
+   lzham_uint8 *pOut_buf, size_t *pOut_buf_size,
+   lzham_flush_t flush_type)
+{
+   return lzham::lzham_lib_compress2(p, pIn_buf, pIn_buf_size, pOut_buf, pOut_buf_size, flush_type);
+}   
+
+extern "C" LZHAM_DLL_EXPORT lzham_bool lzham_compress_reset(lzham_compress_state_ptr p)
+{
+   return lzham::lzham_lib_compress_reset(p);
+}
+
+extern "C" LZHAM_DLL_EXPORT size_t lzham_compress_bound(size_t src_len)
+{
+   return lzham::lzham_lib_compress_bound(src_len);
+}
+
+extern "C" LZHAM_DLL_EXPORT lzham_uint64 lzham_compress_get_memory_requirements(const lzham_compress_params *pParams)
+{
+   return lzham::lzham_lib_compress_get_memory_requirements(pParams);
+}
+
 extern "C" LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress_memory(const lzham_compress_params *pParams, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
 {
    return lzham::lzham_lib_compress_memory(pParams, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
 }
 
+extern "C" LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress_memory_with_state(lzham_compress_state_ptr p, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+{
+   return lzham::lzham_lib_compress_memory_with_state(p, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
+}
+
+extern "C" LZHAM_DLL_EXPORT lzham_compress_status_t lzham_compress_framed_memory(const lzham_compress_params *pParams, lzham_uint32 frame_size, lzham_uint8* pDst_buf, size_t *pDst_len, const lzham_uint8* pSrc_buf, size_t src_len, lzham_uint32 *pAdler32)
+{
+   return lzham::lzham_lib_compress_framed_memory(pParams, frame_size, pDst_buf, pDst_len, pSrc_buf, src_len, pAdler32);
+}